@@ -0,0 +1,145 @@
+// Id map lookups and memory: IdTable against the std::unordered_map it
+// replaced, for rosters of 10k, 100k and 1M entries.  Heap use is counted
+// by the replaced operator new below, and compared with what
+// IdTable::GetMemoryUsage reports.  Build with the sources it uses, e.g.
+//   cl /O2 /EHsc /std:c++20 /I..\src id_table_bench.cpp ..\src\id_table.cpp ..\src\mapped_file.cpp
+
+#include "id_table.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <malloc.h> // _msize() or malloc_usable_size()
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Bytes allocated and not yet released, as the C runtime sized the blocks
+	size_t heap_bytes = 0;
+
+	size_t GetBlockSize(void* block)
+	{
+#ifdef _WIN32
+		return _msize(block);
+#else
+		return malloc_usable_size(block);
+#endif // _WIN32
+	}
+
+	std::wstring MakeEmail(size_t i)
+	{
+		return L"student" + std::to_wstring(i * 7919 % 1000003) + L"@example.ac.uk";
+	}
+}
+
+// The array and nothrow forms end up in these three by default, so every
+// block is counted the same way on the way in and out.  Nothing here is
+// over-aligned, so the aligned forms are left alone
+void* operator new(size_t size)
+{
+	void* block = std::malloc(size ? size : 1);
+	if (!block) throw std::bad_alloc();
+
+	heap_bytes += GetBlockSize(block);
+	return block;
+}
+
+void operator delete(void* block) noexcept
+{
+	if (!block) return;
+
+	heap_bytes -= GetBlockSize(block);
+	std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+	operator delete(block);
+}
+
+int main()
+{
+	std::printf("%9s %13s %13s %8s %13s %13s %13s\n", "Entries", 
+		"map ns/find", "table ns/find", "Speedup", "map bytes", "table bytes", "GetMemoryUsage");
+
+	for (size_t n_entries : { 10000, 100000, 1000000 })
+	{
+		// The roster as it is in the map file
+		std::vector<std::wstring> emails;
+		std::vector<std::wstring> ids;
+		std::string text;
+		for (size_t i = 0; i < n_entries; ++i)
+		{
+			emails.push_back(MakeEmail(i));
+			ids.push_back(std::to_wstring(10000000 + i));
+			text += std::string(emails[i].begin(), emails[i].end()) + '\t' + 
+				std::string(ids[i].begin(), ids[i].end()) + "\r\n";
+		}
+
+		// Lookups come through views of file names, one in ten of them missing
+		std::vector<std::wstring> queries;
+		std::mt19937 random(42);
+		for (size_t i = 0; i < 1000000; ++i)
+		{
+			size_t k = random() % n_entries;
+			queries.push_back(i % 10 ? emails[k] : L"missing" + emails[k]);
+		}
+
+		size_t heap_before = heap_bytes;
+		size_t map_bytes = 0;
+		double map_seconds = 0;
+		size_t n_map_found = 0;
+		{
+			std::unordered_map<std::wstring, std::wstring> map;
+			for (size_t i = 0; i < n_entries; ++i) map[emails[i]] = ids[i] + L".pdf";
+			map_bytes = heap_bytes - heap_before;
+
+			// The program used to build a std::wstring for every lookup
+			Clock::time_point start = Clock::now();
+			for (const std::wstring& query : queries)
+			{
+				std::wstring_view name = query;
+				n_map_found += map.find(std::wstring(name)) != map.end();
+			}
+			map_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		heap_before = heap_bytes;
+		size_t table_bytes = 0;
+		size_t table_usage = 0;
+		double table_seconds = 0;
+		size_t n_table_found = 0;
+		{
+			IdTable table;
+			table.InsertLines(text, L".pdf");
+			table_bytes = heap_bytes - heap_before;
+			table_usage = table.GetMemoryUsage();
+
+			Clock::time_point start = Clock::now();
+			for (const std::wstring& query : queries)
+			{
+				n_table_found += table.Find(query).has_value();
+			}
+			table_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		if (n_map_found != n_table_found)
+		{
+			std::printf("Lookups differ: %zu and %zu found\n", n_map_found, n_table_found);
+			return 1;
+		}
+
+		std::printf("%9zu %13.1f %13.1f %7.1fx %13zu %13zu %13zu\n", n_entries, 
+			map_seconds * 1e9 / queries.size(), table_seconds * 1e9 / queries.size(), 
+			map_seconds / table_seconds, map_bytes, table_bytes, table_usage);
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+// JSON loading: documents shaped like the merge manifest, of a few
+// megabytes, loaded through an istream, from a buffer, and parsed into
+// events without building a tree.  Only the istream path is timed when
+// built with JSON_BENCH_ISTREAM_ONLY, which lets the same source build
+// against json.h from before the buffer parser for comparison, e.g.
+//   cl /O2 /EHsc /std:c++20 /I..\src json_bench.cpp
+
+#include "json.h"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::wstring MakeFingerprint(size_t i)
+	{
+		return L"{\"Size\": " + std::to_wstring(100000 + i * 37) + 
+			L", \"Mtime\": " + std::to_wstring(1700000000 - i) + 
+			L", \"Hash\": \"" + std::to_wstring(0x9e3779b97f4a7c15ull * (i + 1)) + L"\"}";
+	}
+
+	// One entry per merged file, as in .merge_manifest.json.  Numbers fit
+	// in an int, which was all the former parser could read
+	std::wstring MakeManifest(size_t n_entries)
+	{
+		std::wstring out = L"{\n";
+		for (size_t i = 0; i < n_entries; ++i)
+		{
+			out += L"\t\"Scripts\\\\Group " + std::to_wstring(i % 40) + L"\\\\" + std::to_wstring(10000000 + i) + 
+				L".pdf\": {\n\t\t\"Script\": " + MakeFingerprint(i) + 
+				L",\n\t\t\"Front page\": " + MakeFingerprint(i + n_entries) + L"\n\t}";
+			out += i + 1 < n_entries ? L",\n" : L"\n";
+		}
+
+		return out + L"}";
+	}
+
+	template <typename F>
+	double GetBestSeconds(size_t n_runs, F&& f)
+	{
+		double out = 1e100;
+		for (size_t run = 0; run < n_runs; ++run)
+		{
+			Clock::time_point start = Clock::now();
+			f();
+			out = std::min(out, std::chrono::duration<double>(Clock::now() - start).count());
+		}
+
+		return out;
+	}
+}
+
+int main()
+{
+	std::printf("%9s %9s %12s %12s %12s\n", "Entries", "MB", "istream ms", "buffer ms", "events ms");
+
+	for (size_t n_entries : { 10000, 50000, 200000 })
+	{
+		std::wstring text = MakeManifest(n_entries);
+		double mb = text.size() / double(1 << 20); // In characters, as the parser sees them
+
+		size_t n_loaded = 0;
+		double stream_seconds = GetBestSeconds(3, [&]
+			{
+				std::wistringstream iss(text);
+				auto doc = json::Load(iss);
+				n_loaded = doc.GetRoot().AsMap().size();
+			});
+		if (n_loaded != n_entries)
+		{
+			std::printf("%zu entries loaded out of %zu\n", n_loaded, n_entries);
+			return 1;
+		}
+
+		double buffer_seconds = 0;
+		double event_seconds = 0;
+#ifndef JSON_BENCH_ISTREAM_ONLY
+		buffer_seconds = GetBestSeconds(3, [&]
+			{
+				auto doc = json::Load(std::wstring_view(text));
+				n_loaded = doc.GetRoot().AsMap().size();
+			});
+
+		event_seconds = GetBestSeconds(3, [&]
+			{
+				json::EventHandler<wchar_t> handler;
+				json::Parse(std::wstring_view(text), handler);
+			});
+#endif // !JSON_BENCH_ISTREAM_ONLY
+
+		std::printf("%9zu %9.1f %12.1f %12.1f %12.1f\n", n_entries, mb, 
+			stream_seconds * 1e3, buffer_seconds * 1e3, event_seconds * 1e3);
+	}
+
+	return 0;
+}
\ No newline at end of file
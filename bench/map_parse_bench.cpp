@@ -0,0 +1,117 @@
+// Id map parsing: the line-by-line wifstream parser the program used to have
+// against mapping the file and filling an IdTable with IdTable::InsertLines.
+// Build with the sources it uses, e.g.
+//   cl /O2 /EHsc /std:c++20 /I..\src map_parse_bench.cpp ..\src\id_table.cpp ..\src\mapped_file.cpp
+
+#include "id_table.h"
+#include "mapped_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::string MakeEmail(size_t i)
+	{
+		return "student" + std::to_string(i * 7919 % 1000003) + "@example.ac.uk";
+	}
+
+	void WriteRoster(const std::filesystem::path& file, size_t n_lines)
+	{
+		std::ofstream ofs(file, std::ios::binary);
+		for (size_t i = 0; i < n_lines; ++i)
+		{
+			ofs << MakeEmail(i) << '\t' << (10000000 + i) << "\r\n";
+		}
+	}
+
+	// ScriptMerger::ParseMapFile before the map file was mapped
+	size_t ParseWithStream(const std::filesystem::path& file, const std::wstring& script_name_pattern)
+	{
+		std::unordered_map<std::wstring, std::wstring> file_map;
+		std::wifstream ifs(file);
+
+		std::wstring Id1;
+		std::wstring Id2;
+		std::wstring script_file_leaf;
+
+		while (std::getline(ifs, Id1))
+		{
+			script_file_leaf = script_name_pattern;
+
+			size_t pos = Id1.find_first_of('\t');
+			if (pos == std::string::npos) continue;
+
+			Id2 = Id1.substr(pos + 1);
+			Id1 = Id1.substr(0, pos);
+
+			pos = script_file_leaf.find_first_of('*');
+			if (pos != std::string::npos)
+			{
+				script_file_leaf = script_file_leaf.replace(pos, 1, Id1) + L".pdf";
+			}
+			else script_file_leaf += std::move(Id1);
+
+			file_map[script_file_leaf] = Id2 + L".pdf";
+		}
+
+		return file_map.size();
+	}
+
+	size_t ParseMapped(const std::filesystem::path& file)
+	{
+		MappedFile mapping;
+		if (!mapping.Open(file)) return 0;
+
+		IdTable table;
+		table.InsertLines(mapping.View(), L".pdf");
+		return table.Size();
+	}
+
+	template <typename F>
+	double GetBestSeconds(size_t n_runs, F&& f)
+	{
+		double out = 1e100;
+		for (size_t run = 0; run < n_runs; ++run)
+		{
+			Clock::time_point start = Clock::now();
+			f();
+			out = std::min(out, std::chrono::duration<double>(Clock::now() - start).count());
+		}
+
+		return out;
+	}
+}
+
+int main()
+{
+	std::filesystem::path file = std::filesystem::temp_directory_path() / "map_parse_bench.txt";
+
+	std::printf("%10s %14s %14s %10s\n", "Lines", "wifstream ms", "mapped ms", "Speedup");
+	for (size_t n_lines : { 10000, 100000, 1000000 })
+	{
+		WriteRoster(file, n_lines);
+
+		size_t n_stream = 0;
+		size_t n_mapped = 0;
+		double stream = GetBestSeconds(5, [&] { n_stream = ParseWithStream(file, L"*"); });
+		double mapped = GetBestSeconds(5, [&] { n_mapped = ParseMapped(file); });
+
+		if (n_stream != n_lines || n_mapped != n_lines)
+		{
+			std::printf("Entry counts differ: %zu and %zu out of %zu\n", n_stream, n_mapped, n_lines);
+			return 1;
+		}
+
+		std::printf("%10zu %14.2f %14.2f %9.1fx\n", n_lines, stream * 1e3, mapped * 1e3, stream / mapped);
+	}
+
+	std::filesystem::remove(file);
+	return 0;
+}
\ No newline at end of file
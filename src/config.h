@@ -4,10 +4,12 @@
 #include "io_traits.h"
 #include "messages.h"
 
+#include <algorithm>
 #include <conio.h>
 #include <fstream>
 #include <string>
 #include <optional>
+#include <vector>
 
 template <typename T>
 struct Config
@@ -18,7 +20,96 @@ private:
 		return { chars, chars + strlen(chars) };
 	}
 
+	// A narrow literal widened into T on the stack, for lookups and
+	// comparisons through views that allocate nothing
+	template <size_t N>
+	struct Literal
+	{
+		T chars[N] = {};
+
+		constexpr Literal(const char (&literal)[N])
+		{
+			std::copy(literal, literal + N, chars);
+		}
+
+		constexpr operator std::basic_string_view<T>() const { return { chars, N - 1 }; }
+	};
+
+	// A whole number from 0 to max, nothing otherwise
+	static std::optional<size_t> ToCount(std::basic_string_view<T> value, size_t max)
+	{
+		size_t out = 0;
+		if (value.empty()) return std::nullopt;
+
+		for (T c : value)
+		{
+			if (c < '0' || c > '9' || out > max) return std::nullopt;
+			out = out * 10 + (c - '0');
+		}
+
+		if (out > max) return std::nullopt;
+		return out;
+	}
+
+	// The same, with a message when the value is ignored
+	static std::optional<size_t> ParseCount(std::basic_string_view<T> arg, 
+		std::basic_string_view<T> value, size_t max)
+	{
+		std::optional<size_t> out = ToCount(value, max);
+		if (out) return out;
+
+		messages::PostVoidPrompt<T>(std::basic_string<T>(arg) + Convert(" expects a whole number from 0 to ") + 
+			Convert(std::to_string(max).c_str()) + Convert(", ignoring [") + std::basic_string<T>(value) + Convert("]."));
+		return std::nullopt;
+	}
+
+	// "i/n" with 1 <= i <= n <= max_shards.  Anything else is an error rather
+	// than ignored: an instance falling back to 1/1 would merge every file
+	void ParseShard(std::basic_string_view<T> name, std::basic_string_view<T> text)
+	{
+		size_t slash = text.find('/');
+		std::optional<size_t> index = slash != text.npos ? ToCount(text.substr(0, slash), max_shards) : std::nullopt;
+		std::optional<size_t> count = slash != text.npos ? ToCount(text.substr(slash + 1), max_shards) : std::nullopt;
+
+		if (!index || !count || !*index || *index > *count)
+		{
+			messages::PostVoidPrompt<T>(std::basic_string<T>(name) + Convert(" expects i/n with 1 <= i <= n <= ") + 
+				Convert(std::to_string(max_shards).c_str()) + Convert(", got [") + std::basic_string<T>(text) + Convert("]."));
+			has_errors = true;
+			return;
+		}
+
+		shard = *index;
+		n_shards = *count;
+	}
+
+	// "name" or "bytes", an error otherwise
+	void ParseShardBy(std::basic_string_view<T> name, std::basic_string_view<T> text)
+	{
+		if (text == Literal("name") || text == Literal("bytes"))
+		{
+			shard_by_bytes = text == Literal("bytes");
+			return;
+		}
+
+		messages::PostVoidPrompt<T>(std::basic_string<T>(name) + Convert(" expects name or bytes, got [") + 
+			std::basic_string<T>(text) + Convert("]."));
+		has_errors = true;
+	}
+
 public:
+	static constexpr size_t max_threads = 256; // For the merging and the writer threads alike
+	static constexpr size_t max_count = 1 << 20; // For any other count given as an argument
+	static constexpr size_t max_shards = 4096;
+
+	// Scripts matching a pattern and where they go; empty directories stand for the defaults
+	struct PatternRoute
+	{
+		std::basic_string<T> pattern{};
+		std::basic_string<T> front_pages_dir{};
+		std::basic_string<T> output_dir{};
+	};
+
 	// Settings - defaults are set by the constructor
 	std::basic_string<T> scripts_dir{};
 	std::basic_string<T> front_pages_dir{};
@@ -26,6 +117,34 @@ public:
 
 	std::basic_string<T> id_map_name{};
 	std::basic_string<T> script_name_pattern{};
+	std::vector<PatternRoute> script_name_patterns{}; // Replace the single pattern if any
+	std::basic_string<T> report_file{};
+	std::basic_string<T> log_file{}; // Per-file messages while the status line is up
+
+	size_t thread_count = 1;
+	bool incremental = false;
+	bool hash_inputs = false;
+	bool streamed_output = false;
+	bool mapped_input = false;
+	size_t prefetch_depth = 0;
+	size_t prefetch_budget_mb = 512;
+	size_t writer_threads = 0;
+	size_t sync_batch = 0;
+
+	bool batch_mode = false; // No prompts, see messages::BatchSettings
+	messages::OnError on_error = messages::OnError::Retry;
+	size_t retries = 3;
+
+	bool progress = false;
+
+	bool watch = false;
+	size_t watch_debounce_ms = 5000; // Quiet time before a new file counts as complete
+
+	size_t shard = 1; // Counted from 1, as in --shard 2/4
+	size_t n_shards = 1;
+	bool shard_by_bytes = false;
+
+	bool has_errors = false; // A setting that must not be ignored was malformed, the run is not to start
 
 	Config();
 	~Config() = default;
@@ -33,6 +152,7 @@ public:
 	template <typename S>
 	void Read(S&& s);
 	void Read();
+	void ReadArgs(int argc, T* argv[]);
 
 	template <typename S>
 	bool Save(S&& s, std::basic_ostream<T>& tos = io::traits<T>::tcout);
@@ -41,6 +161,7 @@ public:
 	void Print(std::basic_ostream<T>& tos = io::traits<T>::tcout) noexcept;
 	bool Update(std::basic_istream<T>& tis = io::traits<T>::tcin, 
 		std::basic_ostream<T>& tos = io::traits<T>::tcout) noexcept;
+	void TakeEdits(const Config<T>& edited); // Only the settings Update() prompts for
 };
 
 template<typename T>
@@ -65,20 +186,143 @@ void Config<T>::Read(S&& s)
 	
 	typename json::Dict<T>::const_iterator pos;
 
-	pos = json_config.find(Convert("Scripts dir"));
+	pos = json_config.find(Literal("Scripts dir"));
 	if (pos != json_config.end()) scripts_dir = pos->second.AsString();
 
-	pos = json_config.find(Convert("Front pages dir"));
+	pos = json_config.find(Literal("Front pages dir"));
 	if (pos != json_config.end()) front_pages_dir = pos->second.AsString();
 
-	pos = json_config.find(Convert("Output dir"));
+	pos = json_config.find(Literal("Output dir"));
 	if (pos != json_config.end()) output_dir = pos->second.AsString();
 
-	pos = json_config.find(Convert("Map file"));
+	pos = json_config.find(Literal("Map file"));
 	if (pos != json_config.end()) id_map_name = pos->second.AsString();
 
-	pos = json_config.find(Convert("Script name pattern"));
+	pos = json_config.find(Literal("Script name pattern"));
 	if (pos != json_config.end()) script_name_pattern = pos->second.AsString();
+
+	// Either plain patterns or dictionaries routing them to their own directories
+	pos = json_config.find(Literal("Script name patterns"));
+	if (pos != json_config.end() && pos->second.IsArray())
+	{
+		script_name_patterns.clear();
+
+		for (const json::Node<T>& node : pos->second.AsArray())
+		{
+			if (node.IsString())
+			{
+				script_name_patterns.push_back({ node.AsString() });
+				continue;
+			}
+
+			if (!node.IsMap()) continue;
+			const json::Dict<T>& json_route = node.AsMap();
+
+			PatternRoute route;
+			typename json::Dict<T>::const_iterator route_pos;
+
+			route_pos = json_route.find(Literal("Pattern"));
+			if (route_pos == json_route.end()) continue;
+			route.pattern = route_pos->second.AsString();
+
+			route_pos = json_route.find(Literal("Front pages dir"));
+			if (route_pos != json_route.end()) route.front_pages_dir = route_pos->second.AsString();
+
+			route_pos = json_route.find(Literal("Output dir"));
+			if (route_pos != json_route.end()) route.output_dir = route_pos->second.AsString();
+
+			script_name_patterns.push_back(std::move(route));
+		}
+	}
+
+	pos = json_config.find(Literal("Report file"));
+	if (pos != json_config.end() && pos->second.IsString()) report_file = pos->second.AsString();
+
+	pos = json_config.find(Literal("Thread count"));
+	if (pos != json_config.end() && pos->second.IsInt() && 
+		pos->second.AsInt() >= 0 && pos->second.AsInt() <= (int)max_threads)
+	{
+		thread_count = pos->second.AsInt();
+	}
+
+	pos = json_config.find(Literal("Incremental"));
+	if (pos != json_config.end() && pos->second.IsBool()) incremental = pos->second.AsBool();
+
+	pos = json_config.find(Literal("Hash inputs"));
+	if (pos != json_config.end() && pos->second.IsBool()) hash_inputs = pos->second.AsBool();
+
+	pos = json_config.find(Literal("Streamed output"));
+	if (pos != json_config.end() && pos->second.IsBool()) streamed_output = pos->second.AsBool();
+
+	pos = json_config.find(Literal("Memory-mapped input"));
+	if (pos != json_config.end() && pos->second.IsBool()) mapped_input = pos->second.AsBool();
+
+	pos = json_config.find(Literal("Prefetch depth"));
+	if (pos != json_config.end() && pos->second.IsInt() && pos->second.AsInt() >= 0)
+	{
+		prefetch_depth = pos->second.AsInt();
+	}
+
+	pos = json_config.find(Literal("Prefetch budget (MB)"));
+	if (pos != json_config.end() && pos->second.IsInt() && pos->second.AsInt() > 0)
+	{
+		prefetch_budget_mb = pos->second.AsInt();
+	}
+
+	pos = json_config.find(Literal("Writer threads"));
+	if (pos != json_config.end() && pos->second.IsInt() && 
+		pos->second.AsInt() >= 0 && pos->second.AsInt() <= (int)max_threads)
+	{
+		writer_threads = pos->second.AsInt();
+	}
+
+	pos = json_config.find(Literal("Fsync batch"));
+	if (pos != json_config.end() && pos->second.IsInt() && pos->second.AsInt() >= 0)
+	{
+		sync_batch = pos->second.AsInt();
+	}
+
+	pos = json_config.find(Literal("Batch mode"));
+	if (pos != json_config.end() && pos->second.IsBool()) batch_mode = pos->second.AsBool();
+
+	pos = json_config.find(Literal("On error"));
+	if (pos != json_config.end() && pos->second.IsString())
+	{
+		on_error = messages::ParseOnError<T>(pos->second.AsString()).value_or(on_error);
+	}
+
+	pos = json_config.find(Literal("Retries"));
+	if (pos != json_config.end() && pos->second.IsInt() && pos->second.AsInt() >= 0)
+	{
+		retries = pos->second.AsInt();
+	}
+
+	pos = json_config.find(Literal("Progress"));
+	if (pos != json_config.end() && pos->second.IsBool()) progress = pos->second.AsBool();
+
+	pos = json_config.find(Literal("Log file"));
+	if (pos != json_config.end() && pos->second.IsString()) log_file = pos->second.AsString();
+
+	pos = json_config.find(Literal("Watch"));
+	if (pos != json_config.end() && pos->second.IsBool()) watch = pos->second.AsBool();
+
+	pos = json_config.find(Literal("Watch debounce (ms)"));
+	if (pos != json_config.end() && pos->second.IsInt() && pos->second.AsInt() >= 0)
+	{
+		watch_debounce_ms = pos->second.AsInt();
+	}
+
+	pos = json_config.find(Literal("Shard"));
+	if (pos != json_config.end())
+	{
+		ParseShard(Literal("Shard"), pos->second.IsString() ? std::basic_string_view<T>(pos->second.AsString()) : std::basic_string_view<T>());
+	}
+
+	pos = json_config.find(Literal("Shard by"));
+	if (pos != json_config.end())
+	{
+		ParseShardBy(Literal("Shard by"), pos->second.IsString() ? std::basic_string_view<T>(pos->second.AsString()) : std::basic_string_view<T>());
+	}
 }
 
 template<typename T>
@@ -95,6 +339,73 @@ void Config<T>::Read()
 	return Read(".\\config.json"); // ifstream() is not defined for wstring => no ""s...
 }
 
+// Command line options take precedence over the config file
+template<typename T>
+void Config<T>::ReadArgs(int argc, T* argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::basic_string_view<T> arg = argv[i];
+
+		if ((arg == Literal("-j") || arg == Literal("--threads")) && i + 1 < argc)
+		{
+			std::optional<size_t> value = ParseCount(arg, argv[++i], max_threads);
+			if (value) thread_count = *value;
+		}
+		else if (arg == Literal("--prefetch") && i + 1 < argc)
+		{
+			std::optional<size_t> value = ParseCount(arg, argv[++i], max_count);
+			if (value) prefetch_depth = *value;
+		}
+		else if (arg == Literal("--prefetch-mb") && i + 1 < argc)
+		{
+			std::optional<size_t> value = ParseCount(arg, argv[++i], max_count);
+			if (value) prefetch_budget_mb = std::max(*value, (size_t)1);
+		}
+		else if (arg == Literal("--writers") && i + 1 < argc)
+		{
+			std::optional<size_t> value = ParseCount(arg, argv[++i], max_threads);
+			if (value) writer_threads = *value;
+		}
+		else if (arg == Literal("--fsync-batch") && i + 1 < argc)
+		{
+			std::optional<size_t> value = ParseCount(arg, argv[++i], max_count);
+			if (value) sync_batch = *value;
+		}
+		else if (arg == Literal("--debounce") && i + 1 < argc)
+		{
+			std::optional<size_t> value = ParseCount(arg, argv[++i], max_count);
+			if (value) watch_debounce_ms = *value;
+		}
+		else if (arg == Literal("--retries") && i + 1 < argc)
+		{
+			std::optional<size_t> value = ParseCount(arg, argv[++i], max_count);
+			if (value) retries = *value;
+		}
+		else if (arg == Literal("--on-error") && i + 1 < argc)
+		{
+			on_error = messages::ParseOnError<T>(argv[++i]).value_or(on_error);
+		}
+		else if (arg == Literal("--scripts") && i + 1 < argc) scripts_dir = argv[++i];
+		else if (arg == Literal("--front-pages") && i + 1 < argc) front_pages_dir = argv[++i];
+		else if (arg == Literal("--output") && i + 1 < argc) output_dir = argv[++i];
+		else if (arg == Literal("--map") && i + 1 < argc) id_map_name = argv[++i];
+		else if (arg == Literal("--pattern") && i + 1 < argc) script_name_pattern = argv[++i];
+		else if (arg == Literal("--report") && i + 1 < argc) report_file = argv[++i];
+		else if (arg == Literal("--incremental")) incremental = true;
+		else if (arg == Literal("--full")) incremental = false;
+		else if (arg == Literal("--hash")) hash_inputs = true;
+		else if (arg == Literal("--streamed")) streamed_output = true;
+		else if (arg == Literal("--mmap")) mapped_input = true;
+		else if (arg == Literal("--batch")) batch_mode = true;
+		else if (arg == Literal("--progress")) progress = true;
+		else if (arg == Literal("--watch")) watch = true;
+		else if (arg == Literal("--shard") && i + 1 < argc) ParseShard(arg, argv[++i]);
+		else if (arg == Literal("--shard-by") && i + 1 < argc) ParseShardBy(arg, argv[++i]);
+		else if (arg == Literal("--log") && i + 1 < argc) log_file = argv[++i];
+	}
+}
+
 template<typename T>
 template<typename S>
 bool Config<T>::Save(S&& s, 
@@ -115,6 +426,40 @@ bool Config<T>::Save(S&& s,
 	json_config[Convert("Map file")] = id_map_name;
 	json_config[Convert("Script name pattern")] = script_name_pattern;
 
+	if (!script_name_patterns.empty())
+	{
+		json::Array<T> json_routes;
+		for (const PatternRoute& route : script_name_patterns)
+		{
+			json::Dict<T> json_route;
+			json_route[Convert("Pattern")] = route.pattern;
+			json_route[Convert("Front pages dir")] = route.front_pages_dir;
+			json_route[Convert("Output dir")] = route.output_dir;
+			json_routes.emplace_back(std::move(json_route));
+		}
+
+		json_config[Convert("Script name patterns")] = std::move(json_routes);
+	}
+	json_config[Convert("Report file")] = report_file;
+	json_config[Convert("Thread count")] = (int)thread_count;
+	json_config[Convert("Incremental")] = incremental;
+	json_config[Convert("Hash inputs")] = hash_inputs;
+	json_config[Convert("Streamed output")] = streamed_output;
+	json_config[Convert("Memory-mapped input")] = mapped_input;
+	json_config[Convert("Prefetch depth")] = (int)prefetch_depth;
+	json_config[Convert("Prefetch budget (MB)")] = (int)prefetch_budget_mb;
+	json_config[Convert("Writer threads")] = (int)writer_threads;
+	json_config[Convert("Fsync batch")] = (int)sync_batch;
+	json_config[Convert("Batch mode")] = batch_mode;
+	json_config[Convert("On error")] = Convert(messages::GetOnErrorName(on_error));
+	json_config[Convert("Retries")] = (int)retries;
+	json_config[Convert("Progress")] = progress;
+	json_config[Convert("Log file")] = log_file;
+	json_config[Convert("Watch")] = watch;
+	json_config[Convert("Watch debounce (ms)")] = (int)watch_debounce_ms;
+	json_config[Convert("Shard")] = Convert((std::to_string(shard) + "/" + std::to_string(n_shards)).c_str());
+	json_config[Convert("Shard by")] = Convert(shard_by_bytes ? "bytes" : "name");
+
 	std::basic_ofstream<T> ofs(std::forward<S>(s));
 	if (!ofs.is_open())
 	{
@@ -140,7 +485,28 @@ void Config<T>::Print(std::basic_ostream<T>& tos) noexcept
 	tos << "  Front page directory = [" << front_pages_dir << "]\r\n";
 	tos << "  Output directory = [" << output_dir << "]\r\n";
 	tos << "  Map from emails to Ids = [" << id_map_name << "]\r\n";
-	tos << "  Script name pattern = [" << script_name_pattern << "]\r\n\r\n";
+	tos << "  Script name pattern = [" << script_name_pattern << "]\r\n";
+	for (const PatternRoute& route : script_name_patterns)
+	{
+		tos << "    Pattern [" << route.pattern << "] -> front pages [" << route.front_pages_dir << 
+			"], output [" << route.output_dir << "]\r\n";
+	}
+	tos << "  Run report file = [" << report_file << "]\r\n";
+	tos << "  Thread count (0 = all cores) = [" << thread_count << "]\r\n";
+	tos << "  Incremental merging = [" << (incremental ? "on" : "off") << 
+		(incremental && hash_inputs ? ", hashing inputs" : "") << "]\r\n";
+	tos << "  Streamed output = [" << (streamed_output ? "on" : "off") << "]\r\n";
+	tos << "  Memory-mapped input = [" << (mapped_input ? "on" : "off") << "]\r\n";
+	tos << "  Prefetch depth (0 = off) = [" << prefetch_depth << "], budget = [" << 
+		prefetch_budget_mb << " MB]\r\n";
+	tos << "  Writer threads (0 = off) = [" << writer_threads << "], fsync batch (0 = off) = [" << 
+		sync_batch << "]\r\n";
+	tos << "  Batch mode = [" << (batch_mode ? "on" : "off") << "], on error = [" << 
+		messages::GetOnErrorName(on_error) << "], retries = [" << retries << "]\r\n";
+	tos << "  Progress line = [" << (progress ? "on" : "off") << "], log file = [" << log_file << "]\r\n";
+	tos << "  Watch mode = [" << (watch ? "on" : "off") << "], debounce = [" << watch_debounce_ms << " ms]\r\n";
+	tos << "  Shard = [" << shard << "/" << n_shards << "], split by = [" << 
+		(shard_by_bytes ? "bytes" : "name") << "]\r\n\r\n";
 }
 
 template<typename T>
@@ -193,4 +559,14 @@ bool Config<T>::Update(std::basic_istream<T>& tis,
 	}
 
 	return true;
+}
+
+template<typename T>
+void Config<T>::TakeEdits(const Config<T>& edited)
+{
+	scripts_dir = edited.scripts_dir;
+	front_pages_dir = edited.front_pages_dir;
+	output_dir = edited.output_dir;
+	id_map_name = edited.id_map_name;
+	script_name_pattern = edited.script_name_pattern;
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "directory_snapshot.h"
+
+#include <mutex>
+
+std::optional<FileStat> FileStat::Of(const std::filesystem::directory_entry& entry)
+{
+	// Directory iteration on Windows caches both, elsewhere this may stat
+	std::error_code ec;
+	FileStat out;
+
+	out.size = entry.file_size(ec);
+	if (ec) return std::nullopt;
+
+	out.mtime = entry.last_write_time(ec);
+	if (ec) return std::nullopt;
+
+	return out;
+}
+
+std::optional<FileStat> FileStat::Of(const std::filesystem::path& file)
+{
+	std::error_code ec;
+	std::filesystem::directory_entry entry(file, ec);
+	if (ec) return std::nullopt;
+
+	return Of(entry);
+}
+
+void DirectorySnapshot::Take(const std::filesystem::path& dir)
+{
+	using namespace std::filesystem;
+
+	std::unordered_map<std::wstring, FileStat> files;
+
+	std::error_code ec;
+	for (directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (!it->is_regular_file(ec)) continue;
+
+		std::optional<FileStat> stat = FileStat::Of(*it);
+		files.emplace(it->path().filename().wstring(), stat.value_or(FileStat{}));
+	}
+
+	std::unique_lock lock(mutex_);
+	dir_ = dir;
+	files_.swap(files);
+}
+
+size_t DirectorySnapshot::Size() const
+{
+	std::shared_lock lock(mutex_);
+	return files_.size();
+}
+
+bool DirectorySnapshot::Contains(const std::wstring& name) const
+{
+	{
+		std::shared_lock lock(mutex_);
+		if (files_.count(name)) return true;
+	}
+
+	// Missed, e.g. added after the snapshot or differing in letter case
+	std::error_code ec;
+	return std::filesystem::exists(dir_ / name, ec);
+}
+
+std::optional<FileStat> DirectorySnapshot::Find(const std::wstring& name) const
+{
+	{
+		std::shared_lock lock(mutex_);
+		auto pos = files_.find(name);
+		if (pos != files_.end()) return pos->second;
+	}
+
+	return FileStat::Of(dir_ / name);
+}
+
+void DirectorySnapshot::Insert(std::wstring name, FileStat stat)
+{
+	std::unique_lock lock(mutex_);
+	files_.insert_or_assign(std::move(name), stat);
+}
+
+void DirectorySnapshot::Erase(const std::wstring& name)
+{
+	std::unique_lock lock(mutex_);
+	files_.erase(name);
+}
\ No newline at end of file
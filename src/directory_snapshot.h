@@ -0,0 +1,40 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// What is known about a file without opening it
+struct FileStat
+{
+	uintmax_t size = 0;
+	std::filesystem::file_time_type mtime{};
+
+	static std::optional<FileStat> Of(const std::filesystem::directory_entry& entry);
+	static std::optional<FileStat> Of(const std::filesystem::path& file);
+};
+
+// File names (with sizes and times) of a single directory read in one go, 
+// so that existence checks do not cost a stat each (slow on network shares)
+class DirectorySnapshot
+{
+private:
+	std::filesystem::path dir_;
+	std::unordered_map<std::wstring, FileStat> files_;
+	mutable std::shared_mutex mutex_;
+
+public:
+	DirectorySnapshot() = default;
+	~DirectorySnapshot() = default;
+
+	void Take(const std::filesystem::path& dir);
+	const std::filesystem::path& GetDir() const { return dir_; }
+	size_t Size() const;
+
+	// Falls back onto the file system when the name is not in the snapshot
+	bool Contains(const std::wstring& name) const;
+	std::optional<FileStat> Find(const std::wstring& name) const;
+	void Insert(std::wstring name, FileStat stat = {});
+	void Erase(const std::wstring& name);
+};
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "directory_watcher.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif // !NOMINMAX
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include <string_view>
+#include <system_error>
+
+#ifdef _WIN32
+namespace
+{
+	constexpr DWORD notify_filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+		FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+}
+
+struct DirectoryWatcher::Watch
+{
+	size_t root = 0;
+	std::filesystem::path dir;
+	HANDLE handle = INVALID_HANDLE_VALUE;
+	OVERLAPPED overlapped{};
+	std::vector<DWORD> buffer = std::vector<DWORD>(buffer_size / sizeof(DWORD)); // Records are DWORD-aligned
+
+	bool Read()
+	{
+		return ReadDirectoryChangesW(handle, buffer.data(), (DWORD)(buffer.size() * sizeof(DWORD)), 
+			TRUE, notify_filter, nullptr, &overlapped, nullptr);
+	}
+
+	~Watch()
+	{
+		if (handle != INVALID_HANDLE_VALUE)
+		{
+			// The buffer has to stay put until the pending read is cancelled
+			DWORD size = 0;
+			if (CancelIoEx(handle, &overlapped)) GetOverlappedResult(handle, &overlapped, &size, TRUE);
+			CloseHandle(handle);
+		}
+		if (overlapped.hEvent) CloseHandle(overlapped.hEvent);
+	}
+};
+
+DirectoryWatcher::DirectoryWatcher() = default;
+
+DirectoryWatcher::~DirectoryWatcher() = default;
+
+bool DirectoryWatcher::Add(const std::filesystem::path& dir)
+{
+	std::unique_ptr<Watch> watch = std::make_unique<Watch>();
+	watch->root = n_roots_;
+	watch->dir = dir;
+
+	watch->handle = CreateFileW(dir.c_str(), FILE_LIST_DIRECTORY, 
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	if (watch->handle == INVALID_HANDLE_VALUE) return false;
+
+	watch->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	if (!watch->overlapped.hEvent || !watch->Read()) return false;
+
+	watches_.push_back(std::move(watch));
+	++n_roots_;
+	return true;
+}
+
+std::vector<DirectoryWatcher::Change> DirectoryWatcher::Wait(std::chrono::milliseconds timeout)
+{
+	std::vector<Change> out;
+
+	std::vector<HANDLE> events;
+	for (const std::unique_ptr<Watch>& watch : watches_) events.push_back(watch->overlapped.hEvent);
+	if (events.empty()) return out;
+
+	DWORD result = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, (DWORD)timeout.count());
+	if (result >= WAIT_OBJECT_0 + events.size()) return out;
+
+	Watch& watch = *watches_[result - WAIT_OBJECT_0];
+	DWORD size = 0;
+	if (GetOverlappedResult(watch.handle, &watch.overlapped, &size, FALSE))
+	{
+		// Nothing returned means the buffer overflowed and any file may have changed
+		if (!size) out.push_back({ watch.root, watch.dir });
+
+		const char* record = (const char*)watch.buffer.data();
+		while (size)
+		{
+			const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)record;
+			out.push_back({ watch.root, watch.dir / 
+				std::wstring_view(info->FileName, info->FileNameLength / sizeof(WCHAR)) });
+
+			if (!info->NextEntryOffset) break;
+			record += info->NextEntryOffset;
+		}
+	}
+
+	watch.Read();
+	return out;
+}
+#else
+namespace
+{
+	constexpr uint32_t event_mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB | 
+		IN_DELETE | IN_MOVED_FROM;
+}
+
+DirectoryWatcher::DirectoryWatcher() :
+	fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	if (fd_ >= 0) close(fd_);
+}
+
+bool DirectoryWatcher::AddTree(size_t root, const std::filesystem::path& dir)
+{
+	int wd = inotify_add_watch(fd_, dir.c_str(), event_mask | IN_ONLYDIR);
+	if (wd < 0) return false;
+	watches_[wd] = { root, dir };
+
+	// inotify is not recursive, so each subdirectory needs a watch of its own
+	std::error_code ec;
+	for (const std::filesystem::directory_entry& entry : 
+		std::filesystem::recursive_directory_iterator(dir, ec))
+	{
+		if (!entry.is_directory()) continue;
+
+		wd = inotify_add_watch(fd_, entry.path().c_str(), event_mask | IN_ONLYDIR);
+		if (wd >= 0) watches_[wd] = { root, entry.path() };
+	}
+
+	return true;
+}
+
+bool DirectoryWatcher::Add(const std::filesystem::path& dir)
+{
+	if (fd_ < 0 || !AddTree(n_roots_, dir)) return false;
+
+	++n_roots_;
+	return true;
+}
+
+std::vector<DirectoryWatcher::Change> DirectoryWatcher::Wait(std::chrono::milliseconds timeout)
+{
+	std::vector<Change> out;
+
+	pollfd pfd{ fd_, POLLIN, 0 };
+	if (fd_ < 0 || poll(&pfd, 1, (int)timeout.count()) <= 0) return out;
+
+	alignas(inotify_event) char buffer[buffer_size];
+	ssize_t size;
+	while ((size = read(fd_, buffer, sizeof(buffer))) > 0)
+	{
+		for (const char* record = buffer; record < buffer + size; )
+		{
+			const inotify_event* event = (const inotify_event*)record;
+			record += sizeof(inotify_event) + event->len;
+
+			// Events were dropped, so any file may have changed
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				for (const auto& [wd, watch] : watches_) out.push_back({ watch.first, watch.second });
+				continue;
+			}
+
+			// The directory is gone
+			if (event->mask & IN_IGNORED)
+			{
+				watches_.erase(event->wd);
+				continue;
+			}
+
+			auto pos = watches_.find(event->wd);
+			if (pos == watches_.end() || !event->len) continue;
+
+			auto [root, dir] = pos->second;
+			std::filesystem::path file = dir / event->name;
+
+			// Files may have landed in a new directory before it was watched
+			if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) AddTree(root, file);
+
+			out.push_back({ root, std::move(file) });
+		}
+	}
+
+	return out;
+}
+#endif // _WIN32
\ No newline at end of file
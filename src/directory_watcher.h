@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Change notifications for directory trees (inotify or ReadDirectoryChangesW).
+// Only tells what may have changed, deletions included: files are to be
+// stat'ed before use
+class DirectoryWatcher
+{
+public:
+	struct Change
+	{
+		size_t root = 0; // Index of the watched tree, in the order of Add()
+		std::filesystem::path file; // A directory if everything in it may have changed
+	};
+
+private:
+	size_t n_roots_ = 0;
+
+#ifdef _WIN32
+	struct Watch;
+	std::vector<std::unique_ptr<Watch>> watches_;
+#else
+	int fd_ = -1;
+	// Subdirectories are watched one by one, keyed by their descriptors
+	std::unordered_map<int, std::pair<size_t, std::filesystem::path>> watches_;
+
+	bool AddTree(size_t root, const std::filesystem::path& dir);
+#endif // _WIN32
+
+public:
+	static constexpr size_t buffer_size = 1 << 16; // Larger ones fail on network shares
+
+	DirectoryWatcher();
+	DirectoryWatcher(const DirectoryWatcher&) = delete;
+	DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+	~DirectoryWatcher();
+
+	// Watches the directory and everything under it
+	bool Add(const std::filesystem::path& dir);
+
+	// Blocks until something changes or the time is up
+	std::vector<Change> Wait(std::chrono::milliseconds timeout);
+};
\ No newline at end of file
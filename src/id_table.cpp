@@ -0,0 +1,258 @@
+#include "id_table.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	// Cache file layout: the header, the slot array, then the arena.
+	// Everything is in native byte order and native wchar_t width
+	struct CacheHeader
+	{
+		static constexpr char magic_value[8] = { 'I', 'D', 'T', 'A', 'B', 'L', 'E', '\0' };
+		static constexpr uint32_t version_value = 1;
+
+		char magic[8] = {};
+		uint32_t version = 0;
+		uint32_t char_size = 0;
+		uint64_t source_size = 0;
+		int64_t source_mtime = 0;
+		uint64_t source_hash = 0;
+		uint64_t size = 0;
+		uint64_t n_slots = 0;
+		uint64_t arena_size = 0;
+	};
+}
+
+void IdTable::UpdateViews()
+{
+	arena_data_ = arena_.data();
+	arena_size_ = arena_.size();
+	slots_data_ = slots_.data();
+	n_slots_ = slots_.size();
+}
+
+void IdTable::Detach()
+{
+	if (!cache_.IsOpen()) return;
+
+	arena_.assign(arena_data_, arena_data_ + arena_size_);
+	slots_.assign(slots_data_, slots_data_ + n_slots_);
+	cache_.Close();
+
+	UpdateViews();
+}
+
+std::wstring_view IdTable::GetKey(const Slot& slot) const
+{
+	return { arena_data_ + slot.key_offset, slot.key_size };
+}
+
+uint32_t IdTable::Hash(std::wstring_view key)
+{
+	return Hash<wchar_t>(key);
+}
+
+size_t IdTable::FindSlot(std::wstring_view key, uint32_t hash) const
+{
+	size_t mask = n_slots_ - 1;
+
+	for (size_t i = hash & mask; ; i = (i + 1) & mask)
+	{
+		const Slot& slot = slots_data_[i];
+
+		if (slot.key_offset == Slot::empty) return i;
+		if (slot.hash == hash && GetKey(slot) == key) return i;
+	}
+}
+
+void IdTable::Rehash(size_t n_slots)
+{
+	Detach();
+
+	std::vector<Slot> slots(n_slots);
+	size_t mask = n_slots - 1;
+
+	for (const Slot& slot : slots_)
+	{
+		if (slot.key_offset == Slot::empty) continue;
+
+		size_t i = slot.hash & mask;
+		while (slots[i].key_offset != Slot::empty) i = (i + 1) & mask;
+		slots[i] = slot;
+	}
+
+	slots_.swap(slots);
+	UpdateViews();
+}
+
+void IdTable::Reserve(size_t n, size_t n_chars)
+{
+	size_t n_slots = 16;
+	while (n_slots < n * 2) n_slots *= 2;
+
+	if (n_slots > n_slots_) Rehash(n_slots);
+
+	// Growing by doubling would leave up to half of a large arena unused
+	if (n_chars)
+	{
+		Detach();
+		arena_.reserve(arena_.size() + n_chars);
+		UpdateViews();
+	}
+}
+
+void IdTable::Clear()
+{
+	cache_.Close();
+	arena_.clear();
+	slots_.clear();
+	size_ = 0;
+
+	UpdateViews();
+}
+
+void IdTable::InsertLines(std::string_view text, std::wstring_view value_suffix)
+{
+	// Skipping the UTF-8 byte order mark
+	if (text.substr(0, 3) == "\xEF\xBB\xBF") text.remove_prefix(3);
+
+	// One slot array and one arena for the whole roster rather than growing
+	// them as it goes; the text itself bounds the characters widened from it
+	size_t n_lines = std::count(text.begin(), text.end(), '\n') + 1;
+	Reserve(size_ + n_lines, text.size() + n_lines * value_suffix.size());
+
+	// memchr() (behind find()) is vectorised by the C runtime, and the lines
+	// are only ever looked at through views into the text
+	while (!text.empty())
+	{
+		size_t eol = text.find('\n');
+		std::string_view line = text.substr(0, eol);
+		text.remove_prefix(eol != std::string_view::npos ? eol + 1 : text.size());
+
+		if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+		// Tab has to be the separator
+		size_t tab = line.find('\t');
+		if (tab == std::string_view::npos) continue;
+
+		// Widened byte by byte into the arena
+		InsertOrAssign(line.substr(0, tab), line.substr(tab + 1), value_suffix);
+	}
+}
+
+std::optional<std::wstring_view> IdTable::Find(std::wstring_view key) const
+{
+	if (!n_slots_) return std::nullopt;
+
+	const Slot& slot = slots_data_[FindSlot(key, Hash(key))];
+	if (slot.key_offset == Slot::empty) return std::nullopt;
+
+	return std::wstring_view{ arena_data_ + slot.value_offset, slot.value_size };
+}
+
+bool IdTable::SaveCache(const std::filesystem::path& file, const Source& source)
+{
+	Detach();
+
+	CacheHeader header;
+	std::memcpy(header.magic, CacheHeader::magic_value, sizeof(header.magic));
+	header.version = CacheHeader::version_value;
+	header.char_size = sizeof(wchar_t);
+	header.source_size = source.size;
+	header.source_mtime = source.mtime;
+	header.source_hash = source.hash;
+	header.size = size_;
+	header.n_slots = n_slots_;
+	header.arena_size = arena_size_;
+
+	// Written aside and renamed, so a cache is never seen half written
+	std::filesystem::path temp = file;
+	temp += L".tmp";
+	{
+		std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write((const char*)slots_data_, n_slots_ * sizeof(Slot));
+		ofs.write((const char*)arena_data_, arena_size_ * sizeof(wchar_t));
+
+		if (!ofs.flush())
+		{
+			ofs.close();
+			std::error_code ec;
+			std::filesystem::remove(temp, ec);
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(temp, file, ec);
+	if (ec) std::filesystem::remove(temp, ec);
+
+	return !ec;
+}
+
+bool IdTable::LoadCache(const std::filesystem::path& file, Source& source)
+{
+	Clear();
+
+	if (!cache_.Open(file)) return false;
+
+	CacheHeader header;
+	if (cache_.Size() < sizeof(header))
+	{
+		cache_.Close();
+		return false;
+	}
+	std::memcpy(&header, cache_.Data(), sizeof(header));
+
+	// A cache from another build or platform is rejected by the header, and
+	// one that was cut short by its size
+	bool valid = !std::memcmp(header.magic, CacheHeader::magic_value, sizeof(header.magic)) &&
+		header.version == CacheHeader::version_value &&
+		header.char_size == sizeof(wchar_t) &&
+		header.n_slots && !(header.n_slots & (header.n_slots - 1)) &&
+		header.size * 2 <= header.n_slots &&
+		header.arena_size <= UINT32_MAX &&
+		cache_.Size() == sizeof(header) + 
+			header.n_slots * sizeof(Slot) + header.arena_size * sizeof(wchar_t);
+
+	if (valid)
+	{
+		slots_data_ = (const Slot*)(cache_.Data() + sizeof(header));
+		n_slots_ = (size_t)header.n_slots;
+		arena_data_ = (const wchar_t*)(cache_.Data() + sizeof(header) + n_slots_ * sizeof(Slot));
+		arena_size_ = (size_t)header.arena_size;
+		size_ = (size_t)header.size;
+
+		// Offsets are checked once here rather than on every lookup, and so is
+		// the count of entries: probing relies on some slots being empty
+		size_t n_occupied = 0;
+		for (size_t i = 0; valid && i < n_slots_; ++i)
+		{
+			const Slot& slot = slots_data_[i];
+			if (slot.key_offset == Slot::empty) continue;
+
+			valid = (uint64_t)slot.key_offset + slot.key_size <= arena_size_ &&
+				(uint64_t)slot.value_offset + slot.value_size <= arena_size_;
+			++n_occupied;
+		}
+		valid = valid && n_occupied == size_;
+	}
+
+	if (!valid)
+	{
+		Clear();
+		return false;
+	}
+
+	source.size = header.source_size;
+	source.mtime = header.source_mtime;
+	source.hash = header.source_hash;
+
+	return true;
+}
+
+size_t IdTable::GetMemoryUsage() const
+{
+	return arena_.capacity() * sizeof(wchar_t) + slots_.capacity() * sizeof(Slot);
+}
\ No newline at end of file
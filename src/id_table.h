@@ -0,0 +1,168 @@
+#pragma once
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <type_traits>
+#include <string_view>
+#include <vector>
+
+// Map from email Ids to front page file names as a flat open-addressing
+// hash table.  Keys and values live back to back in a single character
+// arena, slots only hold offsets into it, and lookups take views.
+// Slots and arena can be saved as is and mapped back from a cache file
+class IdTable
+{
+public:
+	// The map file a cache was compiled from
+	struct Source
+	{
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		uint64_t hash = 0;
+	};
+
+private:
+	struct Slot
+	{
+		static constexpr uint32_t empty = UINT32_MAX;
+
+		uint32_t hash = 0;
+		uint32_t key_offset = empty;
+		uint32_t key_size = 0;
+		uint32_t value_offset = 0;
+		uint32_t value_size = 0;
+	};
+
+	std::vector<wchar_t> arena_;
+	std::vector<Slot> slots_; // Capacity is a power of two, probed linearly
+	size_t size_ = 0;
+
+	// Lookups go through these, pointing either at the vectors or into cache_
+	const wchar_t* arena_data_ = nullptr;
+	size_t arena_size_ = 0;
+	const Slot* slots_data_ = nullptr;
+	size_t n_slots_ = 0;
+	MappedFile cache_;
+
+	void UpdateViews();
+	// Copies a mapped table into the vectors before it is modified
+	void Detach();
+
+	std::wstring_view GetKey(const Slot& slot) const;
+	size_t FindSlot(std::wstring_view key, uint32_t hash) const;
+	void Rehash(size_t n_slots);
+
+	template <typename Char>
+	uint32_t Append(std::basic_string_view<Char> chars);
+
+public:
+	IdTable() = default;
+	IdTable(const IdTable&) = delete;
+	IdTable& operator=(const IdTable&) = delete;
+	~IdTable() = default;
+
+	static uint32_t Hash(std::wstring_view key);
+	template <typename Char>
+	static uint32_t Hash(std::basic_string_view<Char> key);
+
+	// Room for n entries without rehashing, and for n_chars more characters
+	// of keys and values without growing the arena
+	void Reserve(size_t n, size_t n_chars = 0);
+	void Clear();
+
+	// Narrow (plain ASCII) input is widened character by character straight
+	// into the arena; value_suffix is appended to the value
+	template <typename Char>
+	void InsertOrAssign(std::basic_string_view<Char> key, 
+		std::basic_string_view<Char> value, 
+		std::wstring_view value_suffix = {});
+
+	// Lines of "key<tab>value" (plain ASCII, as in the map file), with
+	// value_suffix appended to each value
+	void InsertLines(std::string_view text, std::wstring_view value_suffix = {});
+
+	std::optional<std::wstring_view> Find(std::wstring_view key) const;
+
+	// The cache is only valid on the platform that wrote it, a mismatching
+	// or damaged file fails to load and leaves the table empty.  Saving
+	// copies a mapped table out of its file first, which could not be
+	// replaced while mapped on Windows
+	bool SaveCache(const std::filesystem::path& file, const Source& source);
+	bool LoadCache(const std::filesystem::path& file, Source& source);
+	bool IsMapped() const { return cache_.IsOpen(); }
+
+	size_t Size() const { return size_; }
+	bool Empty() const { return !size_; }
+	size_t GetMemoryUsage() const;
+};
+
+template <typename Char>
+uint32_t IdTable::Hash(std::basic_string_view<Char> key)
+{
+	// 32-bit FNV-1a over whole characters, the same for narrow and wide keys
+	uint32_t out = 2166136261u;
+	for (Char c : key)
+	{
+		out ^= (uint32_t)(std::make_unsigned_t<Char>)c;
+		out *= 16777619u;
+	}
+
+	return out;
+}
+
+template <typename Char>
+uint32_t IdTable::Append(std::basic_string_view<Char> chars)
+{
+	uint32_t out = (uint32_t)arena_.size();
+	for (Char c : chars) arena_.push_back((wchar_t)(std::make_unsigned_t<Char>)c);
+
+	return out;
+}
+
+template <typename Char>
+void IdTable::InsertOrAssign(std::basic_string_view<Char> key, 
+	std::basic_string_view<Char> value, 
+	std::wstring_view value_suffix)
+{
+	if (key.empty()) return;
+	Detach();
+
+	// Keeping the load factor at or below 1/2
+	if ((size_ + 1) * 2 > slots_.size()) Rehash(std::max(slots_.size() * 2, (size_t)16));
+
+	uint32_t hash = Hash(key);
+	size_t mask = slots_.size() - 1;
+	size_t i = hash & mask;
+
+	for (; slots_[i].key_offset != Slot::empty; i = (i + 1) & mask)
+	{
+		if (slots_[i].hash != hash || slots_[i].key_size != key.size()) continue;
+
+		// Comparing the widened key character by character
+		std::wstring_view stored = GetKey(slots_[i]);
+		if (std::equal(stored.begin(), stored.end(), key.begin(), 
+			[](wchar_t lhs, Char rhs) { return lhs == (wchar_t)(std::make_unsigned_t<Char>)rhs; }))
+		{
+			break;
+		}
+	}
+
+	Slot& slot = slots_[i];
+	if (slot.key_offset == Slot::empty)
+	{
+		slot.hash = hash;
+		slot.key_offset = Append(key);
+		slot.key_size = (uint32_t)key.size();
+		++size_;
+	}
+
+	// A reassigned value is appended anew, the old one stays unreferenced
+	slot.value_offset = Append(value);
+	Append(value_suffix);
+	slot.value_size = (uint32_t)(value.size() + value_suffix.size());
+
+	UpdateViews();
+}
\ No newline at end of file
@@ -4,53 +4,157 @@
 #include <cwctype>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <string_view>
 
 // Collections
+#include <memory>
+#include <memory_resource>
 #include <vector>
-#include <map>
 
 // Utilities
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <cassert>
 
 namespace json
 {
-    template <typename T>
+    template <typename T, template <typename> class A = std::allocator>
     class Node;
 
-    template <typename T>
+    template <typename T, template <typename> class A = std::allocator>
     class Document;
 
-    // Объявления Dict и Array
-    template <typename T>
-    using Array = std::vector<Node<T>>;
+    // Объявления String, Dict и Array. Все они берут память у аллокатора A
+    // (см. json::pmr ниже)
+    template <typename T, template <typename> class A = std::allocator>
+    using String = std::basic_string<T, std::char_traits<T>, A<T>>;
+
+    template <typename T, template <typename> class A = std::allocator>
+    using Array = std::vector<Node<T, A>, A<Node<T, A>>>;
 
-    // Case-neutral string comparator
+    // Case-neutral character folding
     template <typename T>
-    struct CN_Less
+    T CN_Fold(T c)
     {
-        bool operator()(std::basic_string_view<T> sv1,
-            std::basic_string_view<T> sv2) const
+        return (T)std::towlower((std::make_unsigned_t<T>)c);
+    }
+
+    // Словарь с регистронезависимыми ключами. Пары хранятся плоским массивом
+    // в порядке вставки, ключи ищутся по хеш-таблице индексов, где для каждого
+    // ключа заранее посчитаны его запись в нижнем регистре и хеш
+    template <typename T, template <typename> class A = std::allocator>
+    class Dict
+    {
+    public:
+        using key_type = String<T, A>;
+        using mapped_type = Node<T, A>;
+        // Ключи через итераторы менять нельзя
+        using value_type = std::pair<key_type, Node<T, A>>;
+        using iterator = typename std::vector<value_type, A<value_type>>::iterator;
+        using const_iterator = typename std::vector<value_type, A<value_type>>::const_iterator;
+        using size_type = size_t;
+        using allocator_type = A<value_type>;
+
+    private:
+        struct Slot
         {
-            size_t min_size = (sv1.size() < sv2.size()) ? sv1.size() : sv2.size();
+            static constexpr uint32_t empty = UINT32_MAX;
 
-            for (size_t i = 0; i < min_size; ++i)
-            {
-                T c1 = std::towlower(sv1[i]);
-                T c2 = std::towlower(sv2[i]);
-                if (c1 == c2) continue;
-                if (c1 < c2) return true;
-                return false;
-            }
+            uint32_t hash = 0;
+            uint32_t index = empty;
+        };
 
-            return sv1.size() < sv2.size();
+        struct FoldedKey
+        {
+            String<T, A> key;
+            uint32_t hash = 0;
+        };
+
+        std::vector<value_type, A<value_type>> entries_;
+        std::vector<FoldedKey, A<FoldedKey>> folded_; // Параллельно entries_
+        std::vector<Slot, A<Slot>> slots_; // Размер - степень двойки, заполнен не больше чем наполовину
+
+        static uint32_t Hash(std::basic_string_view<T> key);
+
+        size_t FindSlot(std::basic_string_view<T> key, uint32_t hash) const;
+        size_t FindIndex(std::basic_string_view<T> key) const;
+        void Rehash(size_t n_slots);
+
+        template <typename K>
+        key_type MakeKey(K&& key) const;
+
+        template <typename K, typename... Args>
+        std::pair<iterator, bool> TryEmplace(K&& key, Args&&... args);
+
+    public:
+        Dict() = default;
+        explicit Dict(const allocator_type& alloc) :
+            entries_(alloc),
+            folded_(alloc),
+            slots_(alloc)
+        {
         }
+
+        allocator_type get_allocator() const { return entries_.get_allocator(); }
+
+        iterator begin() { return entries_.begin(); }
+        iterator end() { return entries_.end(); }
+        const_iterator begin() const { return entries_.begin(); }
+        const_iterator end() const { return entries_.end(); }
+        const_iterator cbegin() const { return entries_.cbegin(); }
+        const_iterator cend() const { return entries_.cend(); }
+
+        size_t size() const { return entries_.size(); }
+        bool empty() const { return entries_.empty(); }
+
+        void clear();
+        void reserve(size_t n);
+
+        iterator find(std::basic_string_view<T> key);
+        const_iterator find(std::basic_string_view<T> key) const;
+        bool contains(std::basic_string_view<T> key) const { return FindIndex(key) != Slot::empty; }
+        size_t count(std::basic_string_view<T> key) const { return contains(key); }
+
+        Node<T, A>& at(std::basic_string_view<T> key);
+        const Node<T, A>& at(std::basic_string_view<T> key) const;
+
+        template <typename K>
+        Node<T, A>& operator[](K&& key) { return TryEmplace(std::forward<K>(key)).first->second; }
+
+        // Как у std::map: существующее значение не заменяется
+        template <typename K, typename... Args>
+        std::pair<iterator, bool> emplace(K&& key, Args&&... args);
+        template <typename K, typename... Args>
+        std::pair<iterator, bool> try_emplace(K&& key, Args&&... args);
+        std::pair<iterator, bool> insert(value_type value);
+        template <typename K, typename V>
+        std::pair<iterator, bool> insert_or_assign(K&& key, V&& value);
+
+        size_t erase(std::basic_string_view<T> key);
+        iterator erase(const_iterator pos);
+
+        // Как и у контейнеров std::pmr, аллокаторы должны быть равны
+        void swap(Dict& other) noexcept;
+
+        // Порядок ключей на равенство не влияет
+        bool operator==(const Dict& other) const;
     };
 
-    template <typename T>
-    using Dict = std::map<std::basic_string<T>, Node<T>,
-        CN_Less<T>>;
+    template <typename T, template <typename> class A>
+    void swap(Dict<T, A>& lhs, Dict<T, A>& rhs) noexcept
+    {
+        lhs.swap(rhs);
+    }
 
     // Ошибка разбора json
     class parsing_error : public std::runtime_error
@@ -61,109 +165,21 @@ namespace json
 
     const static char* indent = "\t";
 
-    template <typename T>
+    template <typename T, template <typename> class A = std::allocator>
     using Value = std::variant<std::nullptr_t,
-        bool, int, double,
-        std::basic_string<T>,
-        Array<T>, Dict<T>>;
+        bool, int, int64_t, double,
+        String<T, A>,
+        Array<T, A>, Dict<T, A>>;
 
-    template <typename T>
-    class Node final : Value<T>
+    template <typename T, template <typename> class A>
+    class Node final : Value<T, A>
     {
     public:
         // Открытие доступа к конструкторам variant
-        using Value<T>::Value;
+        using Value<T, A>::Value;
 
         // Открытие доступа к swap
-        using Value<T>::swap;
-
-    private:
-        static void EscapeChars(std::basic_ostream<T>& os, std::basic_string_view<T> sv)
-        {
-            for (char c : sv)
-            {
-                switch (c)
-                {
-                case '\r':
-                    os << "\\r";
-                    break;
-                case '\n':
-                    os << "\\n";
-                    break;
-                case '\t':
-                    os << "\\t";
-                    break;
-                case '\"':
-                    os << "\\\"";
-                    break;
-                case '\\':
-                    os << "\\\\";
-                    break;
-                default:
-                    os << c;
-                    break;
-                }
-            }
-        }
-
-        struct PrintContext
-        {
-            std::basic_ostream<T>& os;
-            mutable size_t indent_count = 0;
-
-            PrintContext(std::basic_ostream<T>& os, size_t indent_count = 0) :
-                os(os),
-                indent_count(indent_count)
-            {
-            }
-        };
-
-        struct ValuePrinter
-        {
-            const PrintContext& pc;
-
-            void AddIndentation(std::basic_string_view<T> prefix = {},
-                std::basic_string_view<T> suffix = {}) const
-            {
-                pc.os << prefix;
-                size_t i = pc.indent_count + 1;
-                while (--i) pc.os << indent;
-                pc.os << suffix;
-            }
-
-            void operator()(std::nullptr_t) const
-            {
-                pc.os << "null";
-            }
-
-            void operator()(bool value) const
-            {
-                pc.os << ((value) ? "true" : "false");
-            }
-
-            // Печать чисел
-            template <typename Value>
-            void operator()(Value value) const
-            {
-                pc.os << value;
-            }
-
-            // Печать строк
-            void operator()(const std::basic_string<T>& string) const
-            {
-                pc.os << '\"';
-                EscapeChars(pc.os, string);
-                pc.os << '\"';
-            }
-
-            // Печать массивов
-            void operator()(const Array<T>& array) const;
-
-            // Печать словарей
-            void operator()(const Dict<T>& map) const;
-        };
-
-        std::basic_ostream<T>& Print(ValuePrinter) const;
+        using Value<T, A>::swap;
 
     public:
         // Constructors are inherited from std::variant
@@ -173,6 +189,7 @@ namespace json
 
         bool IsBool() const;
         bool IsInt() const;
+        bool IsInt64() const; // int или int64_t
         bool IsPureDouble() const;
         bool IsDouble() const;
 
@@ -184,52 +201,62 @@ namespace json
         // Node as...
         bool AsBool() const;
         int AsInt() const;
+        int64_t AsInt64() const;
         double AsDouble() const;
-        std::basic_string<T>& AsString();
-        const std::basic_string<T>& AsString() const;
+        String<T, A>& AsString();
+        const String<T, A>& AsString() const;
 
-        Array<T>& AsArray();
-        const Array<T>& AsArray() const;
+        Array<T, A>& AsArray();
+        const Array<T, A>& AsArray() const;
 
-        Dict<T>& AsMap();
-        const Dict<T>& AsMap() const;
+        Dict<T, A>& AsMap();
+        const Dict<T, A>& AsMap() const;
 
         operator bool() const { return AsBool(); }
         operator int() const { return AsInt(); }
+        operator int64_t() const { return AsInt64(); }
         operator double() const { return AsDouble(); }
 
-        operator std::basic_string<T>& () { return AsString(); }
-        operator const std::basic_string<T>& () const { return AsString(); }
+        operator String<T, A>& () { return AsString(); }
+        operator const String<T, A>& () const { return AsString(); }
 
-        operator Array<T>& () { return AsArray(); }
-        operator const Array<T>& () const { return AsArray(); }
+        operator Array<T, A>& () { return AsArray(); }
+        operator const Array<T, A>& () const { return AsArray(); }
 
-        operator Dict<T>& () { return AsMap(); }
-        operator const Dict<T>& () const { AsMap(); }
+        operator Dict<T, A>& () { return AsMap(); }
+        operator const Dict<T, A>& () const { return AsMap(); }
 
         void Swap(Node& other);
 
+        // Вызывает visitor для хранимого значения
+        template <typename Visitor>
+        decltype(auto) Visit(Visitor&& visitor) const
+        {
+            return std::visit(std::forward<Visitor>(visitor), (const Value<T, A>&)*this);
+        }
+
         bool operator==(const Node& other) const;
         bool operator!=(const Node& other) const;
         std::basic_ostream<T>& operator<<(std::basic_ostream<T>&) const;
     };
 
-    template <typename T>
+    template <typename T, template <typename> class A>
     class Document
     {
     private:
-        Node<T> root_;
+        Node<T, A> root_;
 
     public:
-        explicit Document(Node<T> root);
+        explicit Document(Node<T, A> root);
 
-        Node<T>& GetRoot();
-        const Node<T>& GetRoot() const;
+        Node<T, A>& GetRoot();
+        const Node<T, A>& GetRoot() const;
 
         Document& operator=(const Document& other);
         Document& operator=(Document&& other);
 
-        void Print(std::basic_ostream<T>& os) const;
+        // Компактная печать - без переводов строк и отступов
+        void Print(std::basic_ostream<T>& os, bool compact = false) const;
         void Swap(Document& other);
 
         bool operator==(const Document& other) const;
@@ -255,405 +282,870 @@ namespace json
     }
 
     template <typename T>
-    void SkipSpecChars(std::basic_istream<T>& is)
+    void SkipSpecChars(std::basic_string_view<T>& text)
     {
-        using CharType = typename std::char_traits<T>::char_type;
+        size_t i = 0;
+        while (i < text.size() && 
+            (text[i] == '\r' || text[i] == '\n' ||
+            text[i] == '\t' || text[i] == ' ')) ++i;
 
-        CharType c;
-        while (c = is.peek(),
-            (c == '\r') || (c == '\n') ||
-            (c == '\t') || (c == ' ')) is.get();
+        text.remove_prefix(i);
+    }
+
+    // Разбор документа из непрерывного буфера (строки, отображённого файла)
+    template <typename T, template <typename> class A = std::allocator>
+    Document<T, A> Load(std::basic_string_view<T> text, const A<char>& alloc = {});
+
+    template <typename T, template <typename> class A = std::allocator>
+    Document<T, A> Load(std::basic_istream<T>&, const A<char>& alloc = {});
+
+    // Печать узлов в непрерывный буфер
+    template <typename T>
+    class Writer
+    {
+    private:
+        std::basic_string<T>& out_;
+        bool compact_ = false;
+        size_t indent_count_ = 0;
+
+        void Append(const char* chars)
+        {
+            out_.append(chars, chars + strlen(chars));
+        }
+
+        void NewLine()
+        {
+            if (compact_) return;
+
+            out_.push_back('\n');
+            for (size_t i = 0; i < indent_count_; ++i) Append(indent);
+        }
+
+        template <typename Value>
+        void WriteNumber(Value value);
+        void WriteString(std::basic_string_view<T> string);
+
+        template <template <typename> class A>
+        void WriteArray(const Array<T, A>& array);
+        template <template <typename> class A>
+        void WriteDict(const Dict<T, A>& map);
+
+    public:
+        explicit Writer(std::basic_string<T>& out, bool compact = false) :
+            out_(out),
+            compact_(compact)
+        {
+        }
+
+        template <template <typename> class A>
+        void Write(const Node<T, A>& node);
+    };
+
+    template <typename T>
+    template <template <typename> class A>
+    void Writer<T>::Write(const Node<T, A>& node)
+    {
+        node.Visit([this](const auto& value)
+            {
+                using Value = std::remove_cvref_t<decltype(value)>;
+
+                if constexpr (std::is_same_v<Value, std::nullptr_t>) Append("null");
+                else if constexpr (std::is_same_v<Value, bool>) Append(value ? "true" : "false");
+                else if constexpr (std::is_arithmetic_v<Value>) WriteNumber(value);
+                else if constexpr (std::is_same_v<Value, String<T, A>>) WriteString(value);
+                else if constexpr (std::is_same_v<Value, Array<T, A>>) WriteArray(value);
+                else WriteDict(value);
+            });
     }
 
+    // Печать чисел: to_chars не зависит от локали, а дробные
+    // числа печатает кратчайшей записью, читаемой обратно точно
     template <typename T>
-    Document<T> Load(std::basic_istream<T>&);
+    template <typename Value>
+    void Writer<T>::WriteNumber(Value value)
+    {
+        if constexpr (std::is_floating_point_v<Value>)
+        {
+            // В JSON нет бесконечностей и NaN
+            if (!std::isfinite(value))
+            {
+                Append("null");
+                return;
+            }
+        }
+
+        char buffer[32];
+        char* end = std::to_chars(buffer, buffer + sizeof(buffer) - 2, value).ptr;
+
+        // Целое на вид дробное число иначе прочиталось бы как целое
+        if constexpr (std::is_floating_point_v<Value>)
+        {
+            if (std::find_if(buffer, end, [](char c) { return c == '.' || c == 'e'; }) == end)
+            {
+                *end++ = '.';
+                *end++ = '0';
+            }
+        }
+
+        out_.append(buffer, end);
+    }
+
+    // Печать строк: символы, которые не надо экранировать, копируются кусками
+    template <typename T>
+    void Writer<T>::WriteString(std::basic_string_view<T> string)
+    {
+        static constexpr T special[] = { '"', '\\', '\n', '\r', '\t', 0 };
+
+        out_.push_back('"');
+
+        while (!string.empty())
+        {
+            size_t run = std::min(string.find_first_of(special), string.size());
+            out_.append(string.data(), run);
+            if (run == string.size()) break;
+
+            switch (string[run])
+            {
+            case '\r':
+                Append("\\r");
+                break;
+            case '\n':
+                Append("\\n");
+                break;
+            case '\t':
+                Append("\\t");
+                break;
+            case '"':
+                Append("\\\"");
+                break;
+            default:
+                Append("\\\\");
+                break;
+            }
+
+            string.remove_prefix(run + 1);
+        }
+
+        out_.push_back('"');
+    }
 
     // Печать массивов
     template <typename T>
-    void Node<T>::ValuePrinter::operator()(const Array<T>& array) const
+    template <template <typename> class A>
+    void Writer<T>::WriteArray(const Array<T, A>& array)
     {
-        pc.os << "[\n";
-        ++pc.indent_count;
+        if (array.empty())
+        {
+            Append("[]");
+            return;
+        }
 
-        std::basic_string<T> sep;
+        out_.push_back('[');
+        ++indent_count_;
 
-        for (const Node& node : array)
+        for (size_t i = 0; i < array.size(); ++i)
         {
-            AddIndentation(sep); sep = Convert<T>(",\r\n");
-            node.Print({ {pc.os, pc.indent_count} });
+            if (i) out_.push_back(',');
+            NewLine();
+            Write(array[i]);
         }
 
-        --pc.indent_count;
-        AddIndentation(Convert<T>("\r\n"), Convert<T>("]"));
+        --indent_count_;
+        NewLine();
+        out_.push_back(']');
     }
 
     // Печать словарей
     template <typename T>
-    void Node<T>::ValuePrinter::operator()(const Dict<T>& map) const
+    template <template <typename> class A>
+    void Writer<T>::WriteDict(const Dict<T, A>& map)
     {
-        pc.os << "{\n";
-        ++pc.indent_count;
+        if (map.empty())
+        {
+            Append("{}");
+            return;
+        }
 
-        std::basic_string<T> sep;
+        out_.push_back('{');
+        ++indent_count_;
 
-        for (const std::pair<const std::basic_string<T>, Node>& pair : map)
+        bool first = true;
+        for (const typename Dict<T, A>::value_type& pair : map)
         {
-            AddIndentation(sep); sep = Convert<T>(",\r\n");
-            operator()(pair.first);
-            pc.os << ": "; pair.second.Print({ {pc.os, pc.indent_count} });
+            if (!first) out_.push_back(',');
+            first = false;
+
+            NewLine();
+            WriteString(pair.first);
+            Append(compact_ ? ":" : ": ");
+            Write(pair.second);
         }
 
-        --pc.indent_count;
-        AddIndentation(Convert<T>("\r\n"), Convert<T>("}"));
+        --indent_count_;
+        NewLine();
+        out_.push_back('}');
     }
 
-    template <typename T>
-    bool Node<T>::IsNull() const
+    template <typename T, template <typename> class A>
+    uint32_t Dict<T, A>::Hash(std::basic_string_view<T> key)
+    {
+        // 32-битный FNV-1a по символам в нижнем регистре
+        uint32_t out = 2166136261u;
+        for (T c : key)
+        {
+            out ^= (uint32_t)(std::make_unsigned_t<T>)CN_Fold(c);
+            out *= 16777619u;
+        }
+
+        return out;
+    }
+
+    template <typename T, template <typename> class A>
+    size_t Dict<T, A>::FindSlot(std::basic_string_view<T> key, uint32_t hash) const
+    {
+        size_t mask = slots_.size() - 1;
+
+        for (size_t i = hash & mask; ; i = (i + 1) & mask)
+        {
+            const Slot& slot = slots_[i];
+            if (slot.index == Slot::empty) return i;
+            if (slot.hash != hash) continue;
+
+            // Приводить к нижнему регистру приходится только искомый ключ
+            const String<T, A>& folded = folded_[slot.index].key;
+            if (folded.size() == key.size() &&
+                std::equal(folded.begin(), folded.end(), key.begin(),
+                    [](T lhs, T rhs) { return lhs == CN_Fold(rhs); }))
+            {
+                return i;
+            }
+        }
+    }
+
+    template <typename T, template <typename> class A>
+    size_t Dict<T, A>::FindIndex(std::basic_string_view<T> key) const
+    {
+        if (slots_.empty()) return Slot::empty;
+        return slots_[FindSlot(key, Hash(key))].index;
+    }
+
+    template <typename T, template <typename> class A>
+    void Dict<T, A>::Rehash(size_t n_slots)
+    {
+        slots_.assign(n_slots, Slot{});
+        size_t mask = n_slots - 1;
+
+        for (uint32_t index = 0; index < folded_.size(); ++index)
+        {
+            size_t i = folded_[index].hash & mask;
+            while (slots_[i].index != Slot::empty) i = (i + 1) & mask;
+            slots_[i] = { folded_[index].hash, index };
+        }
+    }
+
+    template <typename T, template <typename> class A>
+    template <typename K>
+    typename Dict<T, A>::key_type Dict<T, A>::MakeKey(K&& key) const
+    {
+        // Ключ берёт память у того же аллокатора, что и словарь
+        if constexpr (std::is_same_v<std::remove_cvref_t<K>, key_type>)
+        {
+            return key_type(std::forward<K>(key), get_allocator());
+        }
+        else
+        {
+            return key_type(std::basic_string_view<T>(key), get_allocator());
+        }
+    }
+
+    template <typename T, template <typename> class A>
+    template <typename K, typename... Args>
+    std::pair<typename Dict<T, A>::iterator, bool> Dict<T, A>::TryEmplace(K&& key, Args&&... args)
+    {
+        std::basic_string_view<T> view = key;
+        uint32_t hash = Hash(view);
+
+        if (!slots_.empty())
+        {
+            uint32_t index = slots_[FindSlot(view, hash)].index;
+            if (index != Slot::empty) return { entries_.begin() + index, false };
+        }
+
+        if ((entries_.size() + 1) * 2 > slots_.size()) Rehash(std::max(slots_.size() * 2, (size_t)8));
+
+        FoldedKey folded{ String<T, A>(view, get_allocator()), hash };
+        for (T& c : folded.key) c = CN_Fold(c);
+
+        size_t i = FindSlot(view, hash);
+        entries_.emplace_back(std::piecewise_construct,
+            std::forward_as_tuple(MakeKey(std::forward<K>(key))),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        folded_.push_back(std::move(folded));
+        slots_[i] = { hash, (uint32_t)(entries_.size() - 1) };
+
+        return { entries_.end() - 1, true };
+    }
+
+    template <typename T, template <typename> class A>
+    void Dict<T, A>::clear()
+    {
+        entries_.clear();
+        folded_.clear();
+        slots_.clear();
+    }
+
+    template <typename T, template <typename> class A>
+    void Dict<T, A>::reserve(size_t n)
+    {
+        entries_.reserve(n);
+        folded_.reserve(n);
+
+        size_t n_slots = 8;
+        while (n_slots < n * 2) n_slots *= 2;
+        if (n_slots > slots_.size()) Rehash(n_slots);
+    }
+
+    template <typename T, template <typename> class A>
+    typename Dict<T, A>::iterator Dict<T, A>::find(std::basic_string_view<T> key)
+    {
+        size_t index = FindIndex(key);
+        return (index != Slot::empty) ? entries_.begin() + index : entries_.end();
+    }
+
+    template <typename T, template <typename> class A>
+    typename Dict<T, A>::const_iterator Dict<T, A>::find(std::basic_string_view<T> key) const
+    {
+        size_t index = FindIndex(key);
+        return (index != Slot::empty) ? entries_.begin() + index : entries_.end();
+    }
+
+    template <typename T, template <typename> class A>
+    Node<T, A>& Dict<T, A>::at(std::basic_string_view<T> key)
+    {
+        size_t index = FindIndex(key);
+        if (index == Slot::empty) throw std::out_of_range("No such key in the map!");
+        return entries_[index].second;
+    }
+
+    template <typename T, template <typename> class A>
+    const Node<T, A>& Dict<T, A>::at(std::basic_string_view<T> key) const
+    {
+        size_t index = FindIndex(key);
+        if (index == Slot::empty) throw std::out_of_range("No such key in the map!");
+        return entries_[index].second;
+    }
+
+    template <typename T, template <typename> class A>
+    template <typename K, typename... Args>
+    std::pair<typename Dict<T, A>::iterator, bool> Dict<T, A>::emplace(K&& key, Args&&... args)
+    {
+        return TryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    template <typename T, template <typename> class A>
+    template <typename K, typename... Args>
+    std::pair<typename Dict<T, A>::iterator, bool> Dict<T, A>::try_emplace(K&& key, Args&&... args)
+    {
+        return TryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    template <typename T, template <typename> class A>
+    std::pair<typename Dict<T, A>::iterator, bool> Dict<T, A>::insert(value_type value)
+    {
+        return TryEmplace(std::move(value.first), std::move(value.second));
+    }
+
+    template <typename T, template <typename> class A>
+    template <typename K, typename V>
+    std::pair<typename Dict<T, A>::iterator, bool> Dict<T, A>::insert_or_assign(K&& key, V&& value)
+    {
+        std::pair<iterator, bool> out = TryEmplace(std::forward<K>(key));
+        out.first->second = std::forward<V>(value);
+
+        return out;
+    }
+
+    template <typename T, template <typename> class A>
+    size_t Dict<T, A>::erase(std::basic_string_view<T> key)
+    {
+        const_iterator pos = find(key);
+        if (pos == end()) return 0;
+
+        erase(pos);
+        return 1;
+    }
+
+    template <typename T, template <typename> class A>
+    typename Dict<T, A>::iterator Dict<T, A>::erase(const_iterator pos)
+    {
+        // Индексы после удалённой пары сдвигаются, таблица строится заново
+        size_t index = pos - entries_.cbegin();
+        iterator out = entries_.erase(pos);
+        folded_.erase(folded_.begin() + index);
+        Rehash(slots_.size());
+
+        return out;
+    }
+
+    template <typename T, template <typename> class A>
+    void Dict<T, A>::swap(Dict& other) noexcept
+    {
+        entries_.swap(other.entries_);
+        folded_.swap(other.folded_);
+        slots_.swap(other.slots_);
+    }
+
+    template <typename T, template <typename> class A>
+    bool Dict<T, A>::operator==(const Dict& other) const
+    {
+        if (size() != other.size()) return false;
+
+        for (const value_type& pair : entries_)
+        {
+            const_iterator pos = other.find(pair.first);
+            if (pos == other.end() || pos->first != pair.first || pos->second != pair.second) return false;
+        }
+
+        return true;
+    }
+
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsNull() const
     {
         return std::holds_alternative<std::nullptr_t>(*this);
     }
 
-    template <typename T>
-    bool Node<T>::IsBool() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsBool() const
     {
         return std::holds_alternative<bool>(*this);
     }
 
-    template <typename T>
-    bool Node<T>::IsInt() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsInt() const
     {
         return std::holds_alternative<int>(*this);
     }
 
-    template <typename T>
-    bool Node<T>::IsPureDouble() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsInt64() const
+    {
+        return IsInt() || std::holds_alternative<int64_t>(*this);
+    }
+
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsPureDouble() const
     {
         return std::holds_alternative<double>(*this);
     }
 
-    template <typename T>
-    bool Node<T>::IsDouble() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsDouble() const
     {
-        return IsPureDouble() || IsInt();
+        return IsPureDouble() || IsInt64();
     }
 
-    template <typename T>
-    bool Node<T>::IsString() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsString() const
     {
-        return std::holds_alternative<std::basic_string<T>>(*this);
+        return std::holds_alternative<String<T, A>>(*this);
     }
 
-    template <typename T>
-    bool Node<T>::IsArray() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsArray() const
     {
-        return std::holds_alternative<Array>(*this);
+        return std::holds_alternative<Array<T, A>>(*this);
     }
 
-    template <typename T>
-    bool Node<T>::IsMap() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::IsMap() const
     {
-        return std::holds_alternative<Dict<T>>(*this);
+        return std::holds_alternative<Dict<T, A>>(*this);
     }
 
-    template <typename T>
-    bool Node<T>::AsBool() const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::AsBool() const
     {
         if (!IsBool()) throw std::logic_error("Incompatible node type!");
         return std::get<bool>(*this);
     }
 
-    template <typename T>
-    int Node<T>::AsInt() const
+    template <typename T, template <typename> class A>
+    int Node<T, A>::AsInt() const
     {
         if (!IsInt()) throw std::logic_error("Incompatible node type!");
         return std::get<int>(*this);
     }
 
-    template <typename T>
-    double Node<T>::AsDouble() const
+    template <typename T, template <typename> class A>
+    int64_t Node<T, A>::AsInt64() const
+    {
+        if (IsInt()) return std::get<int>(*this);
+        if (!IsInt64()) throw std::logic_error("Incompatible node type!");
+        return std::get<int64_t>(*this);
+    }
+
+    template <typename T, template <typename> class A>
+    double Node<T, A>::AsDouble() const
     {
         if (IsPureDouble()) return std::get<double>(*this);
-        if (IsInt()) return (double)std::get<int>(*this);
+        if (IsInt64()) return (double)AsInt64();
 
         throw std::logic_error("Incompatible node type!");
     }
 
-    template <typename T>
-    std::basic_string<T>& Node<T>::AsString()
+    template <typename T, template <typename> class A>
+    String<T, A>& Node<T, A>::AsString()
     {
         if (!IsString()) throw std::logic_error("Incompatible node type!");
-        return std::get<std::basic_string<T>>(*this);
+        return std::get<String<T, A>>(*this);
     }
 
-    template <typename T>
-    const std::basic_string<T>& Node<T>::AsString() const
+    template <typename T, template <typename> class A>
+    const String<T, A>& Node<T, A>::AsString() const
     {
         if (!IsString()) throw std::logic_error("Incompatible node type!");
-        return std::get<std::basic_string<T>>(*this);
+        return std::get<String<T, A>>(*this);
     }
 
-    template <typename T>
-    Array<T>& Node<T>::AsArray()
+    template <typename T, template <typename> class A>
+    Array<T, A>& Node<T, A>::AsArray()
     {
         if (!IsArray()) throw std::logic_error("Incompatible node type!");
-        return std::get<Array<T>>(*this);
+        return std::get<Array<T, A>>(*this);
     }
 
-    template <typename T>
-    const Array<T>& Node<T>::AsArray() const
+    template <typename T, template <typename> class A>
+    const Array<T, A>& Node<T, A>::AsArray() const
     {
         if (!IsArray()) throw std::logic_error("Incompatible node type!");
-        return std::get<Array<T>>(*this);
+        return std::get<Array<T, A>>(*this);
     }
 
-    template <typename T>
-    Dict<T>& Node<T>::AsMap()
+    template <typename T, template <typename> class A>
+    Dict<T, A>& Node<T, A>::AsMap()
     {
         if (!IsMap()) throw std::logic_error("Incompatible node type!");
-        return std::get<Dict<T>>(*this);
+        return std::get<Dict<T, A>>(*this);
     }
 
-    template <typename T>
-    const Dict<T>& Node<T>::AsMap() const
+    template <typename T, template <typename> class A>
+    const Dict<T, A>& Node<T, A>::AsMap() const
     {
         if (!IsMap()) throw std::logic_error("Incompatible node type!");
-        return std::get<Dict<T>>(*this);
+        return std::get<Dict<T, A>>(*this);
     }
 
-    template<typename T>
-    inline void Node<T>::Swap(Node& other)
+    template <typename T, template <typename> class A>
+    inline void Node<T, A>::Swap(Node& other)
     {
-        Value<T>::swap(other);
+        Value<T, A>::swap(other);
     }
 
-    template <typename T>
-    bool Node<T>::operator==(const Node& other) const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::operator==(const Node& other) const
     {
         if (this == &other) return true;
         if (this->index() != other.index()) return false;
-        return (const Value<T>&) * this == (const Value<T>&)other;
+        return (const Value<T, A>&) * this == (const Value<T, A>&)other;
     }
 
-    template <typename T>
-    bool Node<T>::operator !=(const Node& other) const
+    template <typename T, template <typename> class A>
+    bool Node<T, A>::operator !=(const Node& other) const
     {
         return !(*this == other);
     }
 
-    template <typename T>
-    std::basic_ostream<T>& Node<T>::Print(ValuePrinter printer) const
+    template <typename T, template <typename> class A>
+    std::basic_ostream<T>& Node<T, A>::operator<<(std::basic_ostream<T>& os) const
     {
-        std::visit(printer, (Value<T>&) * this);
-        return printer.pc.os;
+        // Всё печатается в буфер и уходит в поток одной записью
+        std::basic_string<T> buffer;
+        Writer<T>(buffer).Write(*this);
+
+        return os.write(buffer.data(), buffer.size());
     }
 
-    template <typename T>
-    std::basic_ostream<T>& Node<T>::operator<<(std::basic_ostream<T>& os) const
+    template <typename T, template <typename> class A>
+    std::basic_ostream<T>& operator<<(std::basic_ostream<T>& os, const Node<T, A>& node)
     {
-        Print(ValuePrinter{ {os, 0} });
-        return os;
+        return node.operator<<(os);
     }
 
     template <typename T>
-    std::basic_ostream<T>& operator<<(std::basic_ostream<T>& os, const Node<T>& node)
+    bool IsDigit(T c)
     {
-        return node.operator<<(os);
+        return c >= '0' && c <= '9';
     }
 
+    // Обработчик событий разбора по умолчанию: всё пропускает.
+    // Обработчику достаточно тех же методов; если метод возвращает false,
+    // разбор прекращается. Строки и ключи передаются видами, которые
+    // действительны только до возврата из метода
     template <typename T>
-    Node<T> LoadNode(std::basic_istream<T>& is);
+    struct EventHandler
+    {
+        bool Null() { return true; }
+        bool Bool(bool) { return true; }
+        bool Int(int) { return true; }
+        bool Int64(int64_t) { return true; }
+        bool Double(double) { return true; }
+        bool String(std::basic_string_view<T>) { return true; }
+
+        bool BeginArray() { return true; }
+        bool EndArray() { return true; }
+
+        bool BeginObject() { return true; }
+        bool Key(std::basic_string_view<T>) { return true; }
+        bool EndObject() { return true; }
+    };
 
-    template <typename T>
-    Node<T> LoadNull(std::basic_istream<T>& is)
+    // Потоковый разбор непрерывного буфера: события передаются обработчику
+    // по мере чтения, дерево не строится
+    template <typename T, typename Handler>
+    class Parser
     {
-        typename std::char_traits<T>::char_type buffer[3];
-        buffer[0] = is.get();
-        buffer[1] = is.get();
-        buffer[2] = is.get();
+    private:
+        std::basic_string_view<T> text_;
+        Handler& handler_;
 
-        if (buffer[0] != 'u' || buffer[1] != 'l' || buffer[2] != 'l')
-        {
-            throw parsing_error("Unrecognised token (typo in null?)");
-        }
+        // Сюда раскрываются строки с escape-последовательностями
+        std::basic_string<T> scratch_;
 
-        // Отсекаем приколы вроде nullnull
-        if (!CheckIfNoSuffix<T>(is.peek()))
+        static constexpr size_t max_number_size = 512;
+
+        bool ParseValue();
+        bool ParseWord(const char* word);
+        bool ParseNumber();
+        std::basic_string_view<T> ParseString();
+        bool ParseArray();
+        bool ParseObject();
+
+    public:
+        Parser(std::basic_string_view<T> text, Handler& handler) :
+            text_(text),
+            handler_(handler)
         {
-            throw parsing_error("Unrecognised token (typo in null?)");
         }
 
-        return Node<T>();
+        // false, если разбор прервал обработчик
+        bool Parse();
+
+        // Неразобранный остаток буфера
+        std::basic_string_view<T> GetRest() const { return text_; }
+    };
+
+    template <typename T, typename Handler>
+    bool Parse(std::basic_string_view<T> text, Handler& handler)
+    {
+        return Parser<T, Handler>(text, handler).Parse();
     }
 
-    template <typename T>
-    Node<T> LoadBool(std::basic_istream<T>& is)
+    template <typename T, typename Handler>
+    bool Parser<T, Handler>::Parse()
     {
-        using CharType = typename std::char_traits<T>::char_type;
+        return ParseValue();
+    }
 
-        CharType buffer[3];
-        buffer[0] = is.get();
-        buffer[1] = is.get();
-        buffer[2] = is.get();
+    template <typename T, typename Handler>
+    bool Parser<T, Handler>::ParseValue()
+    {
+        SkipSpecChars(text_);
 
-        if (!((buffer[0] != 'r') ||
-            (buffer[1] != 'u') ||
-            (buffer[2] != 'e')))
+        if (text_.empty())
         {
-            // Отсекаем приколы вроде truetrue
-            if (CheckIfNoSuffix<T>(is.peek()))
-            {
-                return Node<T>(true);
-            }
+            throw parsing_error("Unexpected end of the document");
         }
 
-        if (!((buffer[0] != 'a') ||
-            (buffer[1] != 'l') ||
-            (buffer[2] != 's')))
+        switch (text_.front())
         {
-            // Отсекаем приколы вроде falsefalse
-            if (is.get() == 'e' &&
-                CheckIfNoSuffix<T>(is.peek()))
+        case '[':
+            text_.remove_prefix(1);
+            return ParseArray();
+        case '{':
+            text_.remove_prefix(1);
+            return ParseObject();
+        case '"':
+            text_.remove_prefix(1);
+            return handler_.String(ParseString());
+        case 'n':
+            if (!ParseWord("null"))
+            {
+                throw parsing_error("Unrecognised token (typo in null?)");
+            }
+            return handler_.Null();
+        case 't':
+            if (!ParseWord("true"))
+            {
+                throw parsing_error("Unrecognised token (typo in true/false?)");
+            }
+            return handler_.Bool(true);
+        case 'f':
+            if (!ParseWord("false"))
             {
-                return Node<T>(false);
+                throw parsing_error("Unrecognised token (typo in true/false?)");
             }
+            return handler_.Bool(false);
+        default:
+            return ParseNumber();
         }
+    }
+
+    // Проверяет, что за словом (null, true, false) нет лишних символов
+    template <typename T, typename Handler>
+    bool Parser<T, Handler>::ParseWord(const char* word)
+    {
+        size_t size = strlen(word);
+        if (text_.size() < size || 
+            !std::equal(word, word + size, text_.begin())) return false;
+
+        // Отсекаем приколы вроде nullnull
+        if (text_.size() > size && !CheckIfNoSuffix<T>(text_[size])) return false;
 
-        throw parsing_error("Unrecognised token (typo in true/false?)");
+        text_.remove_prefix(size);
+        return true;
     }
 
-    template <typename T>
-    Node<T> LoadNumber(std::basic_istream<T>& is)
+    template <typename T, typename Handler>
+    bool Parser<T, Handler>::ParseNumber()
     {
-        std::basic_string<T> int_part;
-        std::basic_string<T> frac_part;
-        std::basic_string<T> exp_part;
+        std::basic_string_view<T>& text = text_;
+        size_t i = 0;
+        bool is_int = true;
 
         // Целая часть
-        typename std::char_traits<T>::int_type c = is.get();
-        if (c == '-')
+        if (i < text.size() && text[i] == '-')
         {
-            int_part += c;
-
-            c = is.get();
-            if (!std::isdigit(c))
+            ++i;
+            if (i == text.size() || !IsDigit(text[i]))
             {
                 throw parsing_error("A number cannot consist only of the minus sign");
             }
         }
 
-        if (c == '0')
+        if (i < text.size() && text[i] == '0')
         {
-            int_part += c;
-
-            if (std::isdigit(is.peek()))
+            ++i;
+            if (i < text.size() && IsDigit(text[i]))
             {
                 throw parsing_error("Numbers with leading zeros are not allowed");
             }
         }
         else
         {
-            int_part += c;
-
-            while (std::isdigit(is.peek()))
+            if (i == text.size() || !IsDigit(text[i]))
             {
-                int_part += is.get();
+                throw parsing_error("Unrecognised token");
             }
+
+            while (i < text.size() && IsDigit(text[i])) ++i;
         }
 
         // Дробная часть
-        if (c = is.peek(); c == '.')
+        if (i < text.size() && text[i] == '.')
         {
-            // Пропускаем точку
-            is.get();
+            is_int = false;
 
-            while (std::isdigit(is.peek()))
-            {
-                frac_part += is.get();
-            }
+            ++i;
+            while (i < text.size() && IsDigit(text[i])) ++i;
         }
 
         // Степень после мантиссы
-        if (c = is.peek(); (c == 'e') || (c == 'E'))
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E'))
         {
-            // Пропускаем e/E
-            is.get();
-
-            if (c = is.peek(); (c == '+') || (c == '-'))
-            {
-                exp_part += is.get();
-            }
-
-            while (std::isdigit(is.peek()))
-            {
-                exp_part += is.get();
-            }
+            is_int = false;
 
-            if (!CheckIfNoSuffix<T>(is.peek()))
-            {
-                throw parsing_error("Unexpected end of a number token");
-            }
+            ++i;
+            if (i < text.size() && (text[i] == '+' || text[i] == '-')) ++i;
+            while (i < text.size() && IsDigit(text[i])) ++i;
         }
-        else if (!CheckIfNoSuffix<T>(c))
+
+        if (i < text.size() && !CheckIfNoSuffix<T>(text[i]))
         {
             throw parsing_error("Unexpected end of a number token");
         }
 
-        if (frac_part.empty() && exp_part.empty())
+        std::basic_string_view<T> token = text.substr(0, i);
+        text.remove_prefix(i);
+
+        // from_chars работает только с char, но в числе одни ASCII-символы
+        char buffer[max_number_size];
+        const char* first = buffer;
+        const char* last = buffer + token.size();
+
+        if constexpr (std::is_same_v<T, char>)
         {
-            try
-            {
-                return { std::stoi(int_part) };
-            }
-            catch (...)
-            {
-                throw parsing_error("Failed number convertion");
-            }
+            first = token.data();
+            last = first + token.size();
         }
         else
         {
-            std::basic_string<T> text_to_number = int_part;
-
-            if (!frac_part.empty())
+            if (token.size() > sizeof(buffer))
             {
-                text_to_number += '.';
-                text_to_number += frac_part;
+                throw parsing_error("Number token is too long");
             }
+            std::copy(token.begin(), token.end(), buffer);
+        }
 
-            if (!exp_part.empty())
-            {
-                text_to_number += 'e';
-                text_to_number += exp_part;
-            }
+        // Целые, не влезающие в int, хранятся как int64_t, а не влезающие
+        // и в него - как double
+        if (is_int)
+        {
+            int64_t value = 0;
+            std::from_chars_result result = std::from_chars(first, last, value);
 
-            try
-            {
-                return { std::stod(text_to_number) };
-            }
-            catch (...)
+            if (result.ec == std::errc() && result.ptr == last)
             {
-                throw parsing_error("Failed number conversion");
+                if (value >= INT_MIN && value <= INT_MAX) return handler_.Int((int)value);
+                return handler_.Int64(value);
             }
         }
+
+        double value = 0;
+        std::from_chars_result result = std::from_chars(first, last, value);
+        if (result.ec != std::errc() || result.ptr != last)
+        {
+            throw parsing_error("Failed number conversion");
+        }
+
+        return handler_.Double(value);
     }
 
     // Считывает содержимое строки JSON-документа
     // Функцию следует использовать после считывания открывающего символа ":
-    template <typename T>
-    Node<T> LoadString(std::basic_istream<T>& is)
+    // строка без escape-последовательностей возвращается видом на буфер
+    template <typename T, typename Handler>
+    std::basic_string_view<T> Parser<T, Handler>::ParseString()
     {
-        using CharType = typename std::char_traits<T>::char_type;
-        std::basic_string<T> string;
+        static constexpr T special[] = { '"', '\\', '\n', '\r', 0 };
+
+        bool is_scratch = false;
 
         while (true)
         {
-            const CharType c = is.get();
-
-            if (c == (CharType)EOF)
+            // Обычные символы копируются целыми кусками
+            size_t run = text_.find_first_of(special);
+            if (run == std::basic_string_view<T>::npos)
             {
-                // Поток закончился до того, как встретили закрывающую кавычку
+                // Буфер закончился до того, как встретили закрывающую кавычку
                 throw parsing_error("Unexpected end of a line (runaway closing \"?)");
             }
 
+            const T c = text_[run];
+            if (c == '"' && !is_scratch)
+            {
+                // Встретили закрывающую кавычку, копировать ничего не нужно
+                std::basic_string_view<T> out = text_.substr(0, run);
+                text_.remove_prefix(run + 1);
+                return out;
+            }
+
+            if (!is_scratch) scratch_.clear();
+            is_scratch = true;
+
+            scratch_.append(text_.data(), run);
+            text_.remove_prefix(run + 1);
+
             if (c == '"')
             {
                 // Встретили закрывающую кавычку
@@ -662,213 +1154,330 @@ namespace json
             else if (c == '\\')
             {
                 // Встретили начало escape-последовательности
-                const CharType escaped_char = is.get();
-                if (escaped_char == (CharType)EOF)
+                if (text_.empty())
                 {
-                    // Поток завершился сразу после символа обратной косой черты
+                    // Буфер завершился сразу после символа обратной косой черты
                     throw parsing_error("String parsing error");
                 }
 
+                const T escaped_char = text_.front();
+                text_.remove_prefix(1);
+
                 // Обрабатываем одну из последовательностей: \\, \n, \t, \r, \"
                 switch (escaped_char)
                 {
                 case 'n':
-                    string.push_back('\n');
+                    scratch_.push_back('\n');
                     break;
                 case 't':
-                    string.push_back('\t');
+                    scratch_.push_back('\t');
                     break;
                 case 'r':
-                    string.push_back('\r');
+                    scratch_.push_back('\r');
                     break;
                 case '"':
-                    string.push_back('"');
+                    scratch_.push_back('"');
                     break;
                 case '\\':
-                    string.push_back('\\');
+                    scratch_.push_back('\\');
                     break;
                 default:
                     // Встретили неизвестную escape-последовательность
-                    throw parsing_error("Unrecognised escape sequence \\" + escaped_char);
+                    throw parsing_error("Unrecognised escape sequence");
                 }
             }
-            else if (c == '\n' || c == '\r')
+            else
             {
                 // Строковый литерал внутри JSON не может прерываться символами \r или \n
                 throw parsing_error("Unexpected end of a line");
             }
-            else
-            {
-                // Просто считываем очередной символ и помещаем его в получаемую строку
-                string.push_back(c);
-            }
         }
 
-        return Node<T>(string);
+        return scratch_;
     }
 
-    template <typename T>
-    Node<T> LoadArray(std::basic_istream<T>& is)
+    template <typename T, typename Handler>
+    bool Parser<T, Handler>::ParseArray()
     {
-        using CharType = typename std::char_traits<T>::char_type;
+        if (!handler_.BeginArray()) return false;
 
-        Array<T> array;
-        CharType c = is.peek();
+        SkipSpecChars(text_);
+        if (!text_.empty() && text_.front() == ']')
+        {
+            text_.remove_prefix(1);
+            return handler_.EndArray();
+        }
 
-        for (; !(c == ']' || c == (CharType)EOF);
-            c = is.peek())
+        while (true)
         {
-            // Пропускаем запятую
-            if (c == ',') is.get();
+            if (!ParseValue()) return false;
+            SkipSpecChars(text_);
+
+            if (text_.empty())
+            {
+                throw parsing_error("Unexpected end of an array (did you forget the closing bracket ']'?)");
+            }
 
-            array.emplace_back(LoadNode(is));
-            SkipSpecChars<T>(is);
+            const T c = text_.front();
+            text_.remove_prefix(1);
+
+            if (c == ']') break;
+            if (c != ',')
+            {
+                throw parsing_error("Error parsing an array (',' or ']' was expected)");
+            }
         }
 
-        if (c == (CharType)EOF)
+        return handler_.EndArray();
+    }
+
+    template <typename T, typename Handler>
+    bool Parser<T, Handler>::ParseObject()
+    {
+        if (!handler_.BeginObject()) return false;
+
+        SkipSpecChars(text_);
+        if (!text_.empty() && text_.front() == '}')
         {
-            throw parsing_error("Unexpected end of an array (did you forget the closing bracket ']'?)");
+            text_.remove_prefix(1);
+            return handler_.EndObject();
         }
 
-        // Пропускаем закрывающую скобку
-        is.get();
+        while (true)
+        {
+            if (text_.empty())
+            {
+                throw parsing_error("Unexpected end of a map (did you forget the closing brace '}'?)");
+            }
+
+            // Пропускаем открывающие кавычки, считываем ключ
+            if (text_.front() != '"')
+            {
+                throw parsing_error("Error parsing a map (a key was expected)");
+            }
+            text_.remove_prefix(1);
+
+            if (!handler_.Key(ParseString())) return false;
+            SkipSpecChars(text_);
+
+            // Достигаем разделителя ':', проверяем
+            if (text_.empty() || text_.front() != ':')
+            {
+                throw parsing_error("Error parsing a map (':' was expected)");
+            }
+            text_.remove_prefix(1);
+
+            if (!ParseValue()) return false;
+            SkipSpecChars(text_);
 
-        return Node<T>(std::move(array));
+            if (text_.empty())
+            {
+                throw parsing_error("Unexpected end of a map (did you forget the closing brace '}'?)");
+            }
+
+            // Достигаем разделителя ',' или конца словаря
+            const T c = text_.front();
+            text_.remove_prefix(1);
+
+            if (c == '}') break;
+            if (c != ',')
+            {
+                throw parsing_error("Error parsing a map (',' or '}' was expected)");
+            }
+            SkipSpecChars(text_);
+        }
+
+        return handler_.EndObject();
     }
 
-    template <typename T>
-    Node<T> LoadDict(std::basic_istream<T>& is)
+    // Обработчик, собирающий из событий дерево узлов
+    template <typename T, template <typename> class A>
+    class DocumentBuilder
     {
-        using CharType = typename std::char_traits<T>::char_type;
+    private:
+        A<char> alloc_; // Из него берут память все узлы документа
+        Node<T, A> root_;
 
-        Dict<T> map;
-        CharType c = is.peek();
+        // Незаконченные массивы и словари, у словарей - ключ текущего значения
+        std::vector<Node<T, A>> stack_;
+        std::vector<std::basic_string<T>> keys_;
 
-        for (; !(c == '}' || c == (CharType)EOF); c = is.peek())
+        bool Add(Node<T, A> node)
         {
-            if (c == '\"')
+            if (stack_.empty())
             {
-                // Пропускаем открывающие кавычки, считываем ключ
-                c = is.get();
-                std::basic_string<T> key = LoadString(is).AsString();
-                SkipSpecChars<T>(is);
-
-                // Достигаем разделителя ':', проверяем
-                c = is.get();
-                if (c != ':')
-                {
-                    throw std::logic_error("Error parsing a map (':' was expected)");
-                }
-                SkipSpecChars<T>(is);
+                root_ = std::move(node);
+            }
+            else if (stack_.back().IsArray())
+            {
+                stack_.back().AsArray().emplace_back(std::move(node));
+            }
+            else
+            {
+                stack_.back().AsMap().emplace(std::move(keys_.back()), std::move(node));
+            }
 
-                map.emplace(std::make_pair(std::move(key), LoadNode(is)));
-                SkipSpecChars<T>(is);
+            return true;
+        }
 
-                // Достигаем разделителя ',', проверяем
-                c = is.peek();
-                if (c == ',') c = is.get();
-            }
+        bool End()
+        {
+            Node<T, A> node = std::move(stack_.back());
+            stack_.pop_back();
+            keys_.pop_back();
 
-            SkipSpecChars<T>(is);
+            return Add(std::move(node));
         }
 
-        if (c == (CharType)EOF)
+    public:
+        explicit DocumentBuilder(const A<char>& alloc = {}) :
+            alloc_(alloc)
         {
-            throw parsing_error("Unexpected end of a map (did you forget the closing brace '}'?)");
         }
 
-        // Пропускаем закрывающую скобку
-        is.get();
+        bool Null() { return Add(Node<T, A>()); }
+        bool Bool(bool value) { return Add(Node<T, A>(value)); }
+        bool Int(int value) { return Add(Node<T, A>(value)); }
+        bool Int64(int64_t value) { return Add(Node<T, A>(value)); }
+        bool Double(double value) { return Add(Node<T, A>(value)); }
+        bool String(std::basic_string_view<T> value) { return Add(Node<T, A>(json::String<T, A>(value, alloc_))); }
 
-        return Node<T>(std::move(map));
-    }
+        bool BeginArray()
+        {
+            stack_.emplace_back(Array<T, A>(alloc_));
+            keys_.emplace_back();
+            return true;
+        }
 
-    template <typename T>
-    Node<T> LoadNode(std::basic_istream<T>& is)
-    {
-        using CharType = typename std::char_traits<T>::char_type;
+        bool EndArray() { return End(); }
 
-        SkipSpecChars<T>(is);
+        bool BeginObject()
+        {
+            stack_.emplace_back(Dict<T, A>(alloc_));
+            keys_.emplace_back();
+            return true;
+        }
 
-        CharType c = is.get();
-        switch (c)
+        bool Key(std::basic_string_view<T> key)
         {
-        case '[':
-            return LoadArray(is);
-        case '{':
-            return LoadDict(is);
-        case '"':
-            return LoadString(is);
-        case 'n':
-            return LoadNull(is);
-        case 't':
-        case 'f':
-            return LoadBool(is);
-        default:
-            is.putback(c);
-            return LoadNumber(is);
+            keys_.back().assign(key);
+            return true;
         }
-    }
 
-    template <typename T>
-    Document<T>::Document(Node<T> root) :
+        bool EndObject() { return End(); }
+
+        Node<T, A> TakeRoot() { return std::move(root_); }
+    };
+
+    template <typename T, template <typename> class A>
+    Document<T, A>::Document(Node<T, A> root) :
         root_(std::move(root))
     {
     }
 
-    template <typename T>
-    Node<T>& Document<T>::GetRoot()
+    template <typename T, template <typename> class A>
+    Node<T, A>& Document<T, A>::GetRoot()
     {
         return root_;
     }
 
-    template <typename T>
-    const Node<T>& Document<T>::GetRoot() const
+    template <typename T, template <typename> class A>
+    const Node<T, A>& Document<T, A>::GetRoot() const
     {
         return root_;
     }
 
-    template <typename T>
-    Document<T>& Document<T>::operator=(const Document& other)
+    template <typename T, template <typename> class A>
+    Document<T, A>& Document<T, A>::operator=(const Document& other)
     {
         root_ = other.root_;
         return *this;
     }
 
-    template <typename T>
-    Document<T>& Document<T>::operator=(Document&& other)
+    template <typename T, template <typename> class A>
+    Document<T, A>& Document<T, A>::operator=(Document&& other)
     {
         Swap(other);
         return *this;
     }
 
-    template <typename T>
-    void Document<T>::Swap(Document& other)
+    template <typename T, template <typename> class A>
+    void Document<T, A>::Swap(Document& other)
     {
         root_.Swap(other.root_);
     }
 
-    template <typename T>
-    bool Document<T>::operator==(const Document& other) const
+    template <typename T, template <typename> class A>
+    bool Document<T, A>::operator==(const Document& other) const
     {
         return root_ == other.root_;
     }
 
-    template <typename T>
-    bool Document<T>::operator!=(const Document& other) const
+    template <typename T, template <typename> class A>
+    bool Document<T, A>::operator!=(const Document& other) const
     {
         return !(*this == other);
     }
 
-    template <typename T>
-    Document<T> Load(std::basic_istream<T>& is)
+    template <typename T, template <typename> class A>
+    Document<T, A> Load(std::basic_string_view<T> text, const A<char>& alloc)
     {
-        return Document{ LoadNode(is) };
+        DocumentBuilder<T, A> builder(alloc);
+        Parse(text, builder);
+
+        return Document{ builder.TakeRoot() };
     }
 
-    template <typename T>
-    void Document<T>::Print(std::basic_ostream<T>& os) const
+    template <typename T, template <typename> class A>
+    Document<T, A> Load(std::basic_istream<T>& is, const A<char>& alloc)
+    {
+        // Поток считывается целиком и разбирается уже из памяти
+        std::basic_string<T> text{ std::istreambuf_iterator<T>(is), 
+            std::istreambuf_iterator<T>() };
+
+        return Load<T, A>(std::basic_string_view<T>(text), alloc);
+    }
+
+    template <typename T, template <typename> class A>
+    void Document<T, A>::Print(std::basic_ostream<T>& os, bool compact) const
     {
-        os << GetRoot();
+        std::basic_string<T> buffer;
+        Writer<T>(buffer, compact).Write(GetRoot());
+
+        os.write(buffer.data(), buffer.size());
     }
+
+    // Документы, все узлы которых берут память у одного std::pmr::memory_resource,
+    // например у std::pmr::monotonic_buffer_resource: тогда освобождение
+    // памяти документа ничего не стоит, а сама она возвращается разом.
+    // Ресурс должен пережить документ
+    namespace pmr
+    {
+        template <typename T>
+        using String = json::String<T, std::pmr::polymorphic_allocator>;
+
+        template <typename T>
+        using Node = json::Node<T, std::pmr::polymorphic_allocator>;
+
+        template <typename T>
+        using Array = json::Array<T, std::pmr::polymorphic_allocator>;
+
+        template <typename T>
+        using Dict = json::Dict<T, std::pmr::polymorphic_allocator>;
+
+        template <typename T>
+        using Document = json::Document<T, std::pmr::polymorphic_allocator>;
+
+        template <typename T>
+        Document<T> Load(std::basic_string_view<T> text, std::pmr::memory_resource* resource)
+        {
+            return json::Load<T, std::pmr::polymorphic_allocator>(text, resource);
+        }
+
+        template <typename T>
+        Document<T> Load(std::basic_istream<T>& is, std::pmr::memory_resource* resource)
+        {
+            return json::Load<T, std::pmr::polymorphic_allocator>(is, resource);
+        }
+    } // namespace pmr
 } // namespace json
\ No newline at end of file
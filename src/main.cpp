@@ -10,6 +10,7 @@
 #include "messages.h"
 #include "script_merger.h"
 
+#include <format>
 #include <iostream>
 
 // #include "..\..\external\PoDoFo\headers\PoDoFo\podofo.h"
@@ -52,34 +53,121 @@
 
 Config<wchar_t> config;
 
-int wmain()
+// Exit codes for running from scripts
+enum ExitCode
+{
+	exit_success = EXIT_SUCCESS, // Every file merged or up to date
+	exit_failure = EXIT_FAILURE, // The run could not start
+	exit_partial = 2, // Some files could not be merged
+	exit_stopped = 3 // Stopped by the "fail" error policy
+};
+
+int wmain(int argc, wchar_t* argv[])
 {
 	using namespace std::string_view_literals;
 	using namespace messages;
 
+	// Combining the reports of sharded runs, nothing is merged
+	if (argc > 2 && argv[1] == L"--merge-reports"sv)
+	{
+		std::vector<std::filesystem::path> reports(argv + 3, argv + argc);
+		if (!RunReport::Merge(reports, argv[2]))
+		{
+			PostVoidPrompt<wchar_t>("Error while merging the run reports!");
+			return exit_failure;
+		}
+
+		PostVoidPrompt<wchar_t>(std::format(L"{0} run report(s) are merged into {1}.", reports.size(), argv[2]));
+		return exit_success;
+	}
+
 	// Reading the config file, filling in defaults if missing.
 	config.Read();
 
+	// Saved back with the interactive edits only, command line overrides are for this run
+	Config<wchar_t> file_config = config;
+	config.ReadArgs(argc, argv);
+	if (config.has_errors) return exit_failure;
+
+	batch_settings.is_batch = config.batch_mode;
+	batch_settings.on_error = config.on_error;
+	batch_settings.retries = config.retries;
+
 	PostVoidPrompt<wchar_t>("Current settings");
 	config.Print();
 
-	if (config.Update())
+	if (!config.batch_mode && config.Update())
 	{
 		PostVoidPrompt<wchar_t>("New settings");
 		config.Print();
-		config.Save();
+
+		file_config.TakeEdits(config);
+		file_config.Save();
 	}
 
+	MergeOptions options;
+	options.thread_count = config.thread_count;
+	options.incremental = config.incremental;
+	options.hash_inputs = config.hash_inputs;
+	options.streamed_output = config.streamed_output;
+	options.mapped_input = config.mapped_input;
+	options.prefetch_depth = config.prefetch_depth;
+	options.prefetch_budget = (uintmax_t)config.prefetch_budget_mb << 20;
+	options.writer_threads = config.writer_threads;
+	options.write_queue = 2 * config.writer_threads;
+	options.sync_batch = config.sync_batch;
+	options.report_file = config.report_file;
+	options.progress = config.progress;
+	options.log_file = config.log_file;
+	options.shard = config.shard - 1;
+	options.n_shards = config.n_shards;
+	options.shard_by_bytes = config.shard_by_bytes;
+
 	ScriptMerger script_merger(config.scripts_dir, 
 		config.front_pages_dir, config.output_dir, 
-		config.script_name_pattern, config.id_map_name);
-	if (!script_merger.IsGood()) return EXIT_FAILURE;
+		config.script_name_pattern, config.id_map_name, 
+		options);
+	if (!script_merger.IsGood()) return is_run_failed ? exit_stopped : exit_failure;
+
+	// Several patterns, each possibly with directories of its own
+	if (!config.script_name_patterns.empty())
+	{
+		std::vector<ScriptRoute> routes;
+		for (const Config<wchar_t>::PatternRoute& route : config.script_name_patterns)
+		{
+			routes.push_back({ route.pattern, route.front_pages_dir, route.output_dir });
+		}
+
+		if (!script_merger.SetRoutes(std::move(routes)))
+		{
+			PostVoidPrompt<wchar_t>(std::format(L"No more than {0} script name patterns are supported!", 
+				ScriptPatterns::max_patterns));
+			return exit_failure;
+		}
+	}
 
 	// Mapping emails to student Ids
-	script_merger.ReadIdMap();
+	if (!script_merger.ReadIdMap()) return exit_stopped;
+
+	// Processing PDFs, then the ones that arrive later if watching
+	bool success = true;
+	if (config.watch)
+	{
+		if (!config.batch_mode) PostVoidPrompt<wchar_t>("Press any key to stop watching.");
 
-	// Processing PDFs
-	script_merger.ProcessPDFs();
+		// Batch runs watch until they are killed
+		success = script_merger.Watch(std::chrono::milliseconds(config.watch_debounce_ms), []
+			{
+				if (config.batch_mode || !_kbhit()) return false;
+
+				_getch();
+				return true;
+			});
+	}
+	else success = script_merger.ProcessPDFs();
+
+	if (!success) return is_run_failed ? exit_stopped : exit_failure;
+	size_t n_failed = script_merger.GetFailedCount();
 
 	/*std::wstring_view mask = config["Script name pattern"];
 	bool use_mask = !mask.empty() && !(mask.find_first_of('*') == std::string::npos);
@@ -149,8 +237,13 @@ int wmain()
 
 	PostMessage(""sv);*/
 	std::cout << "Done!\r\n"sv;
-	std::cout << "Please press any key to exit..."sv;
-	_getch();
+	if (n_failed) std::wcout << std::format(L"{0} file(s) could not be merged.\r\n", n_failed);
+
+	if (!config.batch_mode)
+	{
+		std::cout << "Please press any key to exit..."sv;
+		_getch();
+	}
 
-	return EXIT_SUCCESS;
+	return n_failed ? exit_partial : exit_success;
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif // !NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+bool MappedFile::Open(const std::filesystem::path& file)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	file_ = handle;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || !size.QuadPart)
+	{
+		Close();
+		return false;
+	}
+
+	mapping_ = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping_)
+	{
+		Close();
+		return false;
+	}
+
+	data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	if (!data_)
+	{
+		Close();
+		return false;
+	}
+
+	size_ = (size_t)size.QuadPart;
+#else
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) || !st.st_size)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping holds its own reference to the file
+	if (data == MAP_FAILED) return false;
+
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+	madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+
+	data_ = (const char*)data;
+	size_ = (size_t)st.st_size;
+#endif // _WIN32
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_) CloseHandle(mapping_);
+	if (file_) CloseHandle(file_);
+
+	mapping_ = nullptr;
+	file_ = nullptr;
+#else
+	if (data_) munmap((void*)data_, size_);
+#endif // _WIN32
+
+	data_ = nullptr;
+	size_ = 0;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+// Read-only memory mapping of a whole file, hinted for sequential access
+class MappedFile
+{
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+
+#ifdef _WIN32
+	void* file_ = nullptr;
+	void* mapping_ = nullptr;
+#endif // _WIN32
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { Close(); }
+
+	bool Open(const std::filesystem::path& file);
+	void Close();
+
+	bool IsOpen() const { return data_ != nullptr; }
+	const char* Data() const { return data_; }
+	size_t Size() const { return size_; }
+	std::string_view View() const { return { data_, size_ }; }
+};
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "merge_manifest.h"
+#include "json.h"
+
+#include <format>
+#include <fstream>
+#include <memory_resource>
+
+namespace
+{
+	// Manifest documents live in a per-call arena and are dropped at once
+	using Dict = json::pmr::Dict<wchar_t>;
+	using Node = json::pmr::Node<wchar_t>;
+
+	Node ToNode(const Fingerprint& fingerprint, std::pmr::memory_resource* arena)
+	{
+		Dict out(arena);
+		out[L"Size"] = (int64_t)fingerprint.size;
+		out[L"Mtime"] = fingerprint.mtime;
+		if (fingerprint.hash)
+		{
+			out[L"Hash"] = json::pmr::String<wchar_t>(std::format(L"{:016x}", *fingerprint.hash), arena);
+		}
+
+		return out;
+	}
+
+	std::optional<Fingerprint> FromNode(const Node& node)
+	{
+		if (!node.IsMap()) return std::nullopt;
+		const Dict& dict = node.AsMap();
+
+		Dict::const_iterator size = dict.find(L"Size");
+		Dict::const_iterator mtime = dict.find(L"Mtime");
+		Dict::const_iterator hash = dict.find(L"Hash");
+		if (size == dict.end() || mtime == dict.end()) return std::nullopt;
+
+		Fingerprint out;
+		try
+		{
+			// Manifests written before numbers could be 64-bit kept them as strings
+			out.size = size->second.IsString() ? 
+				std::stoull(std::wstring(size->second.AsString())) : (uintmax_t)size->second.AsInt64();
+			out.mtime = mtime->second.IsString() ? 
+				std::stoll(std::wstring(mtime->second.AsString())) : mtime->second.AsInt64();
+			if (hash != dict.end()) out.hash = std::stoull(std::wstring(hash->second.AsString()), nullptr, 16);
+		}
+		catch (const std::exception&)
+		{
+			return std::nullopt;
+		}
+
+		return out;
+	}
+}
+
+Fingerprint::Fingerprint(const FileStat& stat) :
+	size(stat.size),
+	mtime(stat.mtime.time_since_epoch().count())
+{
+}
+
+bool Fingerprint::Matches(const Fingerprint& previous) const
+{
+	if (size != previous.size) return false;
+
+	// An equal hash vouches for a file that was only touched or copied again
+	if (hash && previous.hash) return *hash == *previous.hash;
+	return mtime == previous.mtime;
+}
+
+Fingerprint Fingerprint::Take(const std::filesystem::path& file, const FileStat& stat, 
+	const Fingerprint* previous)
+{
+	Fingerprint out(stat);
+	if (!previous || previous->size != out.size) return out;
+
+	if (previous->mtime == out.mtime) out.hash = previous->hash;
+	else out.hash = HashFile(file);
+
+	return out;
+}
+
+uint64_t Fingerprint::Hash(std::string_view bytes, uint64_t seed)
+{
+	uint64_t out = seed;
+	for (char c : bytes)
+	{
+		out ^= (unsigned char)c;
+		out *= 1099511628211ull;
+	}
+
+	return out;
+}
+
+uint64_t Fingerprint::HashFile(const std::filesystem::path& file)
+{
+	uint64_t out = hash_seed;
+
+	std::ifstream ifs(file, std::ios::binary);
+	char buffer[1 << 16];
+
+	while (ifs.read(buffer, sizeof(buffer)) || ifs.gcount())
+	{
+		out = Hash({ buffer, (size_t)ifs.gcount() }, out);
+	}
+
+	return out;
+}
+
+void MergeManifest::Load(const std::filesystem::path& file)
+{
+	std::unordered_map<std::wstring, Entry> entries;
+	std::pmr::monotonic_buffer_resource arena;
+
+	std::wifstream ifs(file);
+	if (ifs.is_open())
+	{
+		try
+		{
+			json::pmr::Document<wchar_t> doc = json::pmr::Load(ifs, &arena);
+			if (doc.GetRoot().IsMap())
+			{
+				for (const auto& [output_name, node] : doc.GetRoot().AsMap())
+				{
+					if (!node.IsMap()) continue;
+					const Dict& dict = node.AsMap();
+
+					Dict::const_iterator script = dict.find(L"Script");
+					Dict::const_iterator front_page = dict.find(L"Front page");
+					if (script == dict.end() || front_page == dict.end()) continue;
+
+					std::optional<Fingerprint> script_fp = FromNode(script->second);
+					std::optional<Fingerprint> front_page_fp = FromNode(front_page->second);
+					if (!script_fp || !front_page_fp) continue;
+
+					entries[std::wstring(output_name)] = { *script_fp, *front_page_fp };
+				}
+			}
+		}
+		catch (const std::exception&)
+		{
+			// A broken manifest only means everything gets merged again
+			entries.clear();
+		}
+	}
+
+	std::lock_guard lock(mutex_);
+	entries_.swap(entries);
+}
+
+bool MergeManifest::Save(const std::filesystem::path& file) const
+{
+	std::pmr::monotonic_buffer_resource arena;
+	json::pmr::Document<wchar_t> doc{ Dict(&arena) };
+	Dict& root = doc.GetRoot().AsMap();
+
+	{
+		std::lock_guard lock(mutex_);
+		root.reserve(entries_.size());
+
+		for (const auto& [output_name, entry] : entries_)
+		{
+			Dict node(&arena);
+			node[L"Script"] = ToNode(entry.script, &arena);
+			node[L"Front page"] = ToNode(entry.front_page, &arena);
+			root[output_name] = std::move(node);
+		}
+	}
+
+	std::wofstream ofs(file);
+	if (!ofs.is_open()) return false;
+
+	doc.Print(ofs);
+	return (bool)ofs;
+}
+
+std::optional<MergeManifest::Entry> MergeManifest::Find(const std::wstring& output_name) const
+{
+	std::lock_guard lock(mutex_);
+
+	auto pos = entries_.find(output_name);
+	if (pos == entries_.end()) return std::nullopt;
+	return pos->second;
+}
+
+void MergeManifest::Record(std::wstring output_name, Entry entry)
+{
+	std::lock_guard lock(mutex_);
+	entries_.insert_or_assign(std::move(output_name), std::move(entry));
+}
\ No newline at end of file
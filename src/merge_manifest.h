@@ -0,0 +1,61 @@
+#pragma once
+#include "directory_snapshot.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Identity of an input file as far as incremental merging is concerned
+struct Fingerprint
+{
+	uintmax_t size = 0;
+	int64_t mtime = 0; // Ticks of std::filesystem::file_time_type
+	std::optional<uint64_t> hash; // Content hash, only if asked for
+
+	Fingerprint() = default;
+	Fingerprint(const FileStat& stat);
+
+	// Equal sizes and then equal hashes if both have one, equal mtimes otherwise
+	bool Matches(const Fingerprint& previous) const;
+
+	// Hashed only when the hash can decide: the size is as before but the
+	// mtime is not. An unchanged file carries the previous hash over unread
+	static Fingerprint Take(const std::filesystem::path& file, const FileStat& stat, 
+		const Fingerprint* previous);
+
+	// 64-bit FNV-1a, bytes can be hashed in pieces by passing the previous result
+	static constexpr uint64_t hash_seed = 14695981039346656037ull;
+	static uint64_t Hash(std::string_view bytes, uint64_t seed = hash_seed);
+	static uint64_t HashFile(const std::filesystem::path& file);
+};
+
+// Sidecar record of the inputs each merged file was produced from
+class MergeManifest
+{
+public:
+	struct Entry
+	{
+		Fingerprint script;
+		Fingerprint front_page;
+	};
+
+private:
+	std::unordered_map<std::wstring, Entry> entries_;
+	mutable std::mutex mutex_;
+
+public:
+	static constexpr const wchar_t* file_name = L".merge_manifest.json";
+
+	MergeManifest() = default;
+	~MergeManifest() = default;
+
+	void Load(const std::filesystem::path& file);
+	bool Save(const std::filesystem::path& file) const;
+
+	std::optional<Entry> Find(const std::wstring& output_name) const;
+	void Record(std::wstring output_name, Entry entry);
+};
\ No newline at end of file
@@ -4,13 +4,70 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <conio.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <optional>
+#include <thread>
 
 namespace messages
 {
+	// What a "retry?" prompt is answered with in batch mode
+	enum class OnError
+	{
+		Retry, // Up to retries times, then give up on that step
+		Skip, // Give up on that step at once
+		Fail // Give up and stop the run
+	};
+
+	// In batch mode nothing waits for the terminal: binary prompts are
+	// answered No, string prompts are skipped and retries follow on_error
+	struct BatchSettings
+	{
+		bool is_batch = false;
+		OnError on_error = OnError::Retry;
+		size_t retries = 3;
+		std::chrono::milliseconds retry_delay{ 1000 };
+	};
+
+	inline BatchSettings batch_settings;
+
+	// Set once a prompt has been answered according to OnError::Fail
+	inline std::atomic<bool> is_run_failed = false;
+
+	template <typename T>
+	std::optional<OnError> ParseOnError(std::basic_string_view<T> name)
+	{
+		auto is = [name](const char* value)
+			{
+				return std::equal(name.begin(), name.end(), value, value + strlen(value));
+			};
+
+		if (is("retry")) return OnError::Retry;
+		if (is("skip")) return OnError::Skip;
+		if (is("fail")) return OnError::Fail;
+
+		return std::nullopt;
+	}
+
+	inline const char* GetOnErrorName(OnError on_error)
+	{
+		switch (on_error)
+		{
+		case OnError::Skip:
+			return "skip";
+		case OnError::Fail:
+			return "fail";
+		default:
+			return "retry";
+		}
+	}
+
 	template <typename T, typename Str>
 	inline void PostVoidPrompt(const Str& message, 
 		std::basic_ostream<T>& tos = io::traits<T>::tcout, 
@@ -25,6 +82,13 @@ namespace messages
 		bool add_skip = false)
 	{
 		tos << "**" << message << "\r\n";
+
+		if (batch_settings.is_batch)
+		{
+			tos << (add_skip ? "No (batch mode)\r\n\r\n" : "No (batch mode)\r\n");
+			return false;
+		}
+
 		tos << "Press Y/y/Enter for Yes: ";
 
 		T response = _getch();
@@ -43,6 +107,49 @@ namespace messages
 		}
 	}
 
+	// Yes/No question that batch mode answers with batch_answer
+	template <typename T, typename Str>
+	inline bool PostConfirmPrompt(const Str& message, 
+		bool batch_answer,
+		std::basic_ostream<T>& tos = io::traits<T>::tcout)
+	{
+		if (!batch_settings.is_batch) return PostBinaryPrompt<T>(message, tos);
+
+		tos << "**" << message << "\r\n";
+		tos << (batch_answer ? "Yes (batch mode)\r\n" : "No (batch mode)\r\n");
+		return batch_answer;
+	}
+
+	// "Would you like to retry?" after the attempt-th failure of a step
+	template <typename T>
+	inline bool PostRetryPrompt(size_t attempt, 
+		std::basic_ostream<T>& tos = io::traits<T>::tcout)
+	{
+		if (!batch_settings.is_batch) return PostBinaryPrompt<T>("Would you like to retry?", tos);
+
+		switch (batch_settings.on_error)
+		{
+		case OnError::Retry:
+			if (attempt < batch_settings.retries)
+			{
+				tos << "**Retrying (" << attempt + 1 << " of " << batch_settings.retries << ")...\r\n";
+				std::this_thread::sleep_for(batch_settings.retry_delay);
+				return true;
+			}
+
+			tos << "**Giving up after " << batch_settings.retries << " retries.\r\n";
+			return false;
+
+		case OnError::Fail:
+			is_run_failed = true;
+			tos << "**Stopping the run.\r\n";
+			return false;
+
+		default:
+			return false;
+		}
+	}
+
 	template <typename T, typename Str>
 	inline std::optional<std::basic_string<T>>
 		PostStringPrompt(const Str& message,
@@ -54,6 +161,7 @@ namespace messages
 		std::basic_string<T> out;
 
 		tos << "**" << message << "\r\n";
+		if (batch_settings.is_batch) return std::nullopt;
 
 		do
 		{
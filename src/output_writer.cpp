@@ -0,0 +1,182 @@
+#include "output_writer.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif // !NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+OutputWriter::OutputWriter(size_t n_threads, size_t capacity, size_t sync_batch) :
+	capacity_(std::max(capacity, (size_t)1)),
+	sync_batch_(sync_batch)
+{
+	n_threads = std::max(n_threads, (size_t)1);
+
+	threads_.reserve(n_threads);
+	for (size_t i = 0; i < n_threads; ++i) threads_.emplace_back(&OutputWriter::Run, this);
+}
+
+OutputWriter::~OutputWriter()
+{
+	Close();
+}
+
+void OutputWriter::Submit(std::filesystem::path file, std::string data, Callback on_done)
+{
+	{
+		std::unique_lock lock(queue_mutex_);
+		not_full_.wait(lock, [this] { return queue_.size() < capacity_; });
+		queue_.push({ std::move(file), std::move(data), std::move(on_done) });
+	}
+
+	not_empty_.notify_one();
+}
+
+void OutputWriter::Close()
+{
+	{
+		std::lock_guard lock(queue_mutex_);
+		if (is_stopping_) return;
+		is_stopping_ = true;
+	}
+
+	not_empty_.notify_all();
+	for (std::thread& thread : threads_) thread.join();
+
+	// The last, incomplete batch
+	std::vector<Written> batch;
+	{
+		std::lock_guard lock(batch_mutex_);
+		batch.swap(unsynced_);
+	}
+	Commit(batch);
+}
+
+void OutputWriter::Run()
+{
+	while (true)
+	{
+		Item item;
+		{
+			std::unique_lock lock(queue_mutex_);
+			not_empty_.wait(lock, [this] { return is_stopping_ || !queue_.empty(); });
+			if (queue_.empty()) return;
+
+			item = std::move(queue_.front());
+			queue_.pop();
+		}
+		not_full_.notify_one();
+
+		std::filesystem::path temp = item.file;
+		temp += L".tmp";
+
+		if (!WriteFile(temp, item.data))
+		{
+			std::error_code ec;
+			std::filesystem::remove(temp, ec);
+			if (item.on_done) item.on_done(false);
+			continue;
+		}
+
+		// Freeing the buffer before possibly waiting for the rest of the batch
+		std::string{}.swap(item.data);
+
+		Written written{ std::move(temp), std::move(item.file), std::move(item.on_done) };
+
+		std::vector<Written> batch;
+		if (!sync_batch_) batch.push_back(std::move(written));
+		else
+		{
+			std::lock_guard lock(batch_mutex_);
+			unsynced_.push_back(std::move(written));
+
+			if (unsynced_.size() >= sync_batch_) batch.swap(unsynced_);
+		}
+
+		Commit(batch);
+	}
+}
+
+void OutputWriter::Commit(std::vector<Written>& batch) const
+{
+	if (batch.empty()) return;
+
+	std::vector<bool> is_synced(batch.size(), true);
+	if (sync_batch_)
+	{
+		for (size_t i = 0; i < batch.size(); ++i) is_synced[i] = SyncFile(batch[i].temp);
+	}
+
+	std::vector<bool> is_renamed(batch.size());
+	std::vector<std::filesystem::path> dirs;
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		std::error_code ec;
+		if (is_synced[i]) std::filesystem::rename(batch[i].temp, batch[i].file, ec);
+		if (!is_synced[i] || ec) std::filesystem::remove(batch[i].temp, ec);
+		else is_renamed[i] = true;
+
+		// Routed outputs may land in several directories within one batch
+		std::filesystem::path dir = batch[i].file.parent_path();
+		if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) dirs.push_back(std::move(dir));
+	}
+
+	// Making the renames themselves durable before anyone is told of them
+	if (sync_batch_)
+	{
+		for (const std::filesystem::path& dir : dirs) SyncDirectory(dir);
+	}
+
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		if (batch[i].on_done) batch[i].on_done(is_renamed[i]);
+	}
+}
+
+bool OutputWriter::WriteFile(const std::filesystem::path& file, const std::string& data)
+{
+	std::ofstream ofs(file, std::ios::binary | std::ios::trunc);
+	if (!ofs.is_open()) return false;
+
+	ofs.write(data.data(), data.size());
+	ofs.close();
+	return !ofs.fail();
+}
+
+bool OutputWriter::SyncFile(const std::filesystem::path& file)
+{
+#ifdef _WIN32
+	HANDLE handle = CreateFileW(file.c_str(), GENERIC_WRITE, 0, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+
+	bool out = FlushFileBuffers(handle) != FALSE;
+	CloseHandle(handle);
+	return out;
+#else
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	bool out = !fsync(fd);
+	close(fd);
+	return out;
+#endif // _WIN32
+}
+
+void OutputWriter::SyncDirectory(const std::filesystem::path& dir)
+{
+#ifndef _WIN32
+	int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+	if (fd < 0) return;
+
+	fsync(fd);
+	close(fd);
+#endif // !_WIN32
+}
\ No newline at end of file
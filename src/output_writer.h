@@ -0,0 +1,68 @@
+#pragma once
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes merged files on threads of its own, so that slow output storage
+// does not hold up merging.  Every file goes to a temporary name first and
+// is renamed into place once written (and synced, if syncing is on)
+class OutputWriter
+{
+public:
+	using Callback = std::function<void(bool is_saved)>;
+
+private:
+	struct Item
+	{
+		std::filesystem::path file;
+		std::string data;
+		Callback on_done;
+	};
+
+	struct Written
+	{
+		std::filesystem::path temp;
+		std::filesystem::path file;
+		Callback on_done;
+	};
+
+	std::queue<Item> queue_;
+	size_t capacity_;
+	bool is_stopping_ = false;
+	std::mutex queue_mutex_;
+	std::condition_variable not_empty_;
+	std::condition_variable not_full_;
+
+	// Files waiting for a batched fsync before being renamed
+	std::vector<Written> unsynced_;
+	size_t sync_batch_;
+	std::mutex batch_mutex_;
+
+	std::vector<std::thread> threads_;
+
+	void Run();
+	void Commit(std::vector<Written>& batch) const;
+
+	static bool WriteFile(const std::filesystem::path& file, const std::string& data);
+	static bool SyncFile(const std::filesystem::path& file);
+	static void SyncDirectory(const std::filesystem::path& dir);
+
+public:
+	OutputWriter() = delete;
+	// sync_batch of 0 turns syncing off
+	OutputWriter(size_t n_threads, size_t capacity, size_t sync_batch);
+	OutputWriter(const OutputWriter&) = delete;
+	OutputWriter& operator=(const OutputWriter&) = delete;
+	~OutputWriter();
+
+	// Blocks while the queue is full; on_done is called on a writer thread
+	void Submit(std::filesystem::path file, std::string data, Callback on_done);
+
+	// Writes out everything queued so far and stops the threads
+	void Close();
+};
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "prefetcher.h"
+#include "script_merger.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif // !_WIN32
+
+Prefetcher::Prefetcher(const std::vector<MergeJob>& jobs, size_t depth, uintmax_t byte_budget) :
+	jobs_(jobs),
+	slots_(jobs.size()),
+	depth_(std::max(depth, (size_t)1)),
+	byte_budget_(byte_budget)
+{
+	thread_ = std::thread(&Prefetcher::Run, this);
+}
+
+Prefetcher::~Prefetcher()
+{
+	{
+		std::lock_guard lock(mutex_);
+		is_stopping_ = true;
+	}
+
+	slot_taken_.notify_all();
+	thread_.join();
+}
+
+void Prefetcher::Run()
+{
+	for (size_t i = 0; i < jobs_.size(); ++i)
+	{
+		if (jobs_[i].status != MergeJob::Status::Ready) continue;
+
+		// Waiting for room, though a single job always gets through
+		{
+			std::unique_lock lock(mutex_);
+			slot_taken_.wait(lock, [this]
+				{
+					return is_stopping_ || !n_in_flight_ ||
+						(n_in_flight_ < depth_ && bytes_in_flight_ < byte_budget_);
+				});
+			if (is_stopping_) return;
+		}
+
+		PrefetchedInputs inputs;
+		if (!ReadFile(jobs_[i].front_page, inputs.front_page) ||
+			!ReadFile(jobs_[i].script, inputs.script))
+		{
+			// Merging falls back onto reading the files by itself
+			inputs = {};
+		}
+
+		{
+			std::lock_guard lock(mutex_);
+
+			++n_in_flight_;
+			bytes_in_flight_ += inputs.front_page.size() + inputs.script.size();
+			slots_[i].inputs = std::move(inputs);
+			slots_[i].is_ready = true;
+		}
+
+		slot_ready_.notify_all();
+	}
+}
+
+PrefetchedInputs Prefetcher::Take(size_t i)
+{
+	PrefetchedInputs out;
+
+	{
+		std::unique_lock lock(mutex_);
+		Slot& slot = slots_[i];
+
+		slot_ready_.wait(lock, [&slot] { return slot.is_ready; });
+
+		--n_in_flight_;
+		bytes_in_flight_ -= slot.inputs.front_page.size() + slot.inputs.script.size();
+		out = std::move(slot.inputs);
+	}
+
+	slot_taken_.notify_all();
+	return out;
+}
+
+bool Prefetcher::ReadFile(const std::filesystem::path& file, std::string& out)
+{
+#ifdef _WIN32
+	std::ifstream ifs(file, std::ios::binary | std::ios::ate);
+	if (!ifs.is_open()) return false;
+
+	out.resize((size_t)ifs.tellg());
+	ifs.seekg(0);
+	return (bool)ifs.read(out.data(), out.size());
+#else
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	// Letting the kernel start fetching the whole file at once
+	off_t size = lseek(fd, 0, SEEK_END);
+	lseek(fd, 0, SEEK_SET);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	out.resize(size > 0 ? (size_t)size : 0);
+
+	size_t n_read = 0;
+	while (n_read < out.size())
+	{
+		ssize_t n = read(fd, out.data() + n_read, out.size() - n_read);
+		if (n <= 0) break;
+		n_read += (size_t)n;
+	}
+
+	close(fd);
+	return n_read == out.size();
+#endif // _WIN32
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MergeJob;
+
+// Contents of both inputs of a job, read ahead of merging
+struct PrefetchedInputs
+{
+	std::string front_page;
+	std::string script;
+};
+
+// Reads inputs of upcoming jobs on a thread of its own, at most depth jobs
+// (and roughly byte_budget bytes) ahead of the ones being merged
+class Prefetcher
+{
+private:
+	struct Slot
+	{
+		PrefetchedInputs inputs;
+		bool is_ready = false;
+	};
+
+	const std::vector<MergeJob>& jobs_;
+	std::vector<Slot> slots_;
+	size_t depth_;
+	uintmax_t byte_budget_;
+
+	size_t n_in_flight_ = 0;
+	uintmax_t bytes_in_flight_ = 0;
+	bool is_stopping_ = false;
+
+	std::mutex mutex_;
+	std::condition_variable slot_ready_;
+	std::condition_variable slot_taken_;
+	std::thread thread_;
+
+	void Run();
+
+public:
+	Prefetcher() = delete;
+	Prefetcher(const std::vector<MergeJob>& jobs, size_t depth, uintmax_t byte_budget);
+	Prefetcher(const Prefetcher&) = delete;
+	Prefetcher& operator=(const Prefetcher&) = delete;
+	~Prefetcher();
+
+	// Blocks until the inputs of job i have been read, empty if reading failed.
+	// Has to be called exactly once for every job with the Ready status
+	PrefetchedInputs Take(size_t i);
+
+	static bool ReadFile(const std::filesystem::path& file, std::string& out);
+};
\ No newline at end of file
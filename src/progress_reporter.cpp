@@ -0,0 +1,99 @@
+#include "progress_reporter.h"
+
+#include <algorithm>
+#include <format>
+#include <ostream>
+
+namespace
+{
+	std::wstring FormatDuration(double seconds)
+	{
+		uintmax_t total = (uintmax_t)std::max(seconds, 0.);
+		return std::format(L"{0:02}:{1:02}:{2:02}", total / 3600, total / 60 % 60, total % 60);
+	}
+}
+
+ProgressReporter::ProgressReporter(std::wostream& os, size_t n_files, 
+	std::chrono::milliseconds refresh) :
+	os_(os),
+	refresh_(refresh),
+	n_files_(n_files),
+	start_(std::chrono::steady_clock::now())
+{
+	thread_ = std::thread(&ProgressReporter::Run, this);
+}
+
+ProgressReporter::~ProgressReporter()
+{
+	Finish();
+}
+
+void ProgressReporter::Run()
+{
+	std::unique_lock lock(mutex_);
+
+	while (!stop_.wait_for(lock, refresh_, [this] { return is_stopping_; }))
+	{
+		Draw();
+	}
+}
+
+void ProgressReporter::Draw()
+{
+	size_t n_done = n_done_;
+	size_t n_failed = n_failed_;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+
+	double files_per_second = seconds > 0 ? n_done / seconds : 0;
+	double mb_per_second = seconds > 0 ? bytes_done_ / seconds / (1 << 20) : 0;
+	size_t n_remaining = n_files_ - std::min(n_done, n_files_);
+
+	std::wstring line = std::format(L"Done {0}/{1}, failed {2}, remaining {3} | {4:.1f} files/s, {5:.1f} MB/s | ",
+		n_done, n_files_, n_failed, n_remaining, files_per_second, mb_per_second);
+	line += (files_per_second > 0 || !n_remaining) ? 
+		L"ETA " + FormatDuration(n_remaining / std::max(files_per_second, 1e-9)) : L"ETA --:--:--";
+
+	size_t size = line.size();
+	if (size < line_size_) line.append(line_size_ - size, L' ');
+	line_size_ = size;
+
+	os_ << L'\r' << line;
+	os_.flush();
+}
+
+void ProgressReporter::OnFileDone(uintmax_t bytes, bool is_merged)
+{
+	bytes_done_ += bytes;
+	if (!is_merged) ++n_failed_;
+	++n_done_;
+}
+
+void ProgressReporter::OnFileFailed()
+{
+	++n_failed_;
+}
+
+void ProgressReporter::Finish()
+{
+	{
+		std::lock_guard lock(mutex_);
+		if (is_stopping_) return;
+		is_stopping_ = true;
+	}
+
+	stop_.notify_all();
+	thread_.join();
+
+	Draw();
+	os_ << L"\r\n";
+}
+
+bool LogSink::Open(const std::filesystem::path& file)
+{
+	// The buffer has to be in place before anything is written
+	buffer_.resize(buffer_size);
+	ofs_.rdbuf()->pubsetbuf(buffer_.data(), (std::streamsize)buffer_.size());
+	ofs_.open(file, std::ios::out | std::ios::trunc);
+
+	return ofs_.is_open();
+}
\ No newline at end of file
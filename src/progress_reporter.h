@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Single status line for a run (done/failed/remaining, rates and ETA),
+// redrawn by its own thread no more often than the refresh interval
+class ProgressReporter
+{
+private:
+	std::wostream& os_;
+	std::chrono::milliseconds refresh_;
+	size_t n_files_ = 0;
+	std::chrono::steady_clock::time_point start_;
+
+	std::atomic<size_t> n_done_ = 0;
+	std::atomic<size_t> n_failed_ = 0;
+	std::atomic<uintmax_t> bytes_done_ = 0;
+
+	size_t line_size_ = 0; // Leftovers of a longer line are blanked out
+	std::mutex mutex_;
+	std::condition_variable stop_;
+	bool is_stopping_ = false;
+	std::thread thread_;
+
+	void Run();
+	void Draw();
+
+public:
+	static constexpr std::chrono::milliseconds default_refresh{ 250 };
+
+	ProgressReporter() = delete;
+	ProgressReporter(std::wostream& os, size_t n_files, 
+		std::chrono::milliseconds refresh = default_refresh);
+	ProgressReporter(const ProgressReporter&) = delete;
+	ProgressReporter& operator=(const ProgressReporter&) = delete;
+	~ProgressReporter();
+
+	// Any thread; only counters are touched
+	void OnFileDone(uintmax_t bytes, bool is_merged);
+	void OnFileFailed(); // A file counted as done failed at a later stage
+
+	// Draws the final state and moves off the status line
+	void Finish();
+};
+
+// Per-file log going to a file through a large buffer
+class LogSink
+{
+private:
+	std::vector<wchar_t> buffer_;
+	std::wofstream ofs_;
+
+public:
+	static constexpr size_t buffer_size = 1 << 16;
+
+	LogSink() = default;
+	LogSink(const LogSink&) = delete;
+	LogSink& operator=(const LogSink&) = delete;
+	~LogSink() = default;
+
+	bool Open(const std::filesystem::path& file);
+	bool IsOpen() const { return ofs_.is_open(); }
+
+	// Writes are dropped if the sink is not open
+	std::wostream& Stream() { return ofs_; }
+};
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "run_report.h"
+#include "json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory_resource>
+#include <numeric>
+
+namespace
+{
+	// The report is built in an arena that is dropped at once after saving
+	using Dict = json::pmr::Dict<wchar_t>;
+	using Array = json::pmr::Array<wchar_t>;
+	using Node = json::pmr::Node<wchar_t>;
+	using String = json::pmr::String<wchar_t>;
+
+	// Nearest-rank percentile of sorted values
+	double GetPercentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty()) return 0;
+
+		size_t rank = (size_t)std::ceil(p / 100 * sorted.size());
+		return sorted[std::clamp(rank, (size_t)1, sorted.size()) - 1];
+	}
+
+	Node GetPercentiles(std::vector<double> values, std::pmr::memory_resource* arena)
+	{
+		std::sort(values.begin(), values.end());
+
+		Dict out(arena);
+		out[L"p50"] = GetPercentile(values, 50);
+		out[L"p90"] = GetPercentile(values, 90);
+		out[L"p99"] = GetPercentile(values, 99);
+		out[L"Max"] = values.empty() ? 0. : values.back();
+
+		return out;
+	}
+
+	Node ToNode(const FileTiming& timing, std::pmr::memory_resource* arena)
+	{
+		Dict out(arena);
+		out[L"Script"] = String(timing.script, arena);
+		out[L"Output"] = String(timing.output, arena);
+
+		for (size_t i = 0; i < (size_t)Stage::Count; ++i)
+		{
+			out[std::wstring(RunReport::GetStageName((Stage)i)) + L" (s)"] = timing.seconds[i];
+		}
+
+		out[L"Total (s)"] = timing.Total();
+		out[L"Bytes read"] = (int64_t)timing.bytes_read;
+		out[L"Bytes written"] = (int64_t)timing.bytes_written;
+		out[L"Merged"] = timing.is_merged;
+
+		return out;
+	}
+
+	FileTiming FromNode(const Node& node)
+	{
+		const Dict& dict = node.AsMap();
+
+		FileTiming out;
+		out.script = std::wstring(dict.at(L"Script").AsString());
+		out.output = std::wstring(dict.at(L"Output").AsString());
+
+		for (size_t i = 0; i < (size_t)Stage::Count; ++i)
+		{
+			out.seconds[i] = dict.at(std::wstring(RunReport::GetStageName((Stage)i)) + L" (s)").AsDouble();
+		}
+
+		out.bytes_read = (uintmax_t)dict.at(L"Bytes read").AsInt64();
+		out.bytes_written = (uintmax_t)dict.at(L"Bytes written").AsInt64();
+
+		// Reports written before failures were told apart had no such record
+		Dict::const_iterator is_merged = dict.find(L"Merged");
+		if (is_merged != dict.end()) out.is_merged = is_merged->second.AsBool();
+
+		return out;
+	}
+}
+
+double FileTiming::Total() const
+{
+	return std::accumulate(seconds.begin(), seconds.end(), 0.);
+}
+
+const wchar_t* RunReport::GetStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case Stage::LoadFrontPage:
+		return L"Load front page";
+	case Stage::LoadScript:
+		return L"Load script";
+	case Stage::Append:
+		return L"Append pages";
+	case Stage::Save:
+		return L"Save";
+	default:
+		return L"";
+	}
+}
+
+void RunReport::Clear()
+{
+	std::lock_guard lock(mutex_);
+	files_.clear();
+	n_found_ = 0;
+	n_jobs_ = 0;
+	planning_seconds_ = 0;
+}
+
+void RunReport::SetFailed(const std::wstring& output)
+{
+	std::lock_guard lock(mutex_);
+
+	// The latest attempt, as watching may merge the same file again
+	for (auto pos = files_.rbegin(); pos != files_.rend(); ++pos)
+	{
+		if (pos->output != output) continue;
+
+		pos->is_merged = false;
+		break;
+	}
+}
+
+void RunReport::SetPlanning(size_t n_found, size_t n_jobs, double seconds)
+{
+	std::lock_guard lock(mutex_);
+	n_found_ = n_found;
+	n_jobs_ = n_jobs;
+	planning_seconds_ = seconds;
+}
+
+void RunReport::AddPlanning(size_t n_found, size_t n_jobs, double seconds)
+{
+	std::lock_guard lock(mutex_);
+	n_found_ += n_found;
+	n_jobs_ += n_jobs;
+	planning_seconds_ += seconds;
+}
+
+void RunReport::Add(FileTiming timing)
+{
+	std::lock_guard lock(mutex_);
+	files_.push_back(std::move(timing));
+}
+
+bool RunReport::Save(const std::filesystem::path& file) const
+{
+	std::vector<FileTiming> files;
+	std::pmr::monotonic_buffer_resource arena;
+	json::pmr::Document<wchar_t> doc{ Dict(&arena) };
+	Dict& root = doc.GetRoot().AsMap();
+
+	{
+		std::lock_guard lock(mutex_);
+		files = files_;
+		root[L"Scripts found"] = (int)n_found_;
+		root[L"Scripts planned"] = (int)n_jobs_;
+		root[L"Planning (s)"] = planning_seconds_;
+	}
+
+	size_t n_merged = std::count_if(files.begin(), files.end(), 
+		[](const FileTiming& timing) { return timing.is_merged; });
+	root[L"Files merged"] = (int)n_merged;
+	root[L"Files failed"] = (int)(files.size() - n_merged);
+
+	// Totals and percentiles, stage by stage
+	Dict totals(&arena);
+	Dict percentiles(&arena);
+	std::vector<double> values(files.size());
+
+	for (size_t i = 0; i < (size_t)Stage::Count; ++i)
+	{
+		std::transform(files.begin(), files.end(), values.begin(),
+			[i](const FileTiming& timing) { return timing.seconds[i]; });
+
+		std::wstring name = RunReport::GetStageName((Stage)i);
+		totals[name + L" (s)"] = std::accumulate(values.begin(), values.end(), 0.);
+		percentiles[name + L" (s)"] = GetPercentiles(values, &arena);
+	}
+
+	std::transform(files.begin(), files.end(), values.begin(),
+		[](const FileTiming& timing) { return timing.Total(); });
+	totals[L"Total (s)"] = std::accumulate(values.begin(), values.end(), 0.);
+	percentiles[L"Total (s)"] = GetPercentiles(values, &arena);
+
+	uintmax_t bytes_read = 0;
+	uintmax_t bytes_written = 0;
+	for (const FileTiming& timing : files)
+	{
+		bytes_read += timing.bytes_read;
+		bytes_written += timing.bytes_written;
+	}
+	totals[L"Bytes read"] = (int64_t)bytes_read;
+	totals[L"Bytes written"] = (int64_t)bytes_written;
+
+	root[L"Totals"] = std::move(totals);
+	root[L"Percentiles"] = std::move(percentiles);
+
+	// Slowest files first
+	std::sort(files.begin(), files.end(), [](const FileTiming& lhs, const FileTiming& rhs)
+		{
+			return lhs.Total() > rhs.Total();
+		});
+
+	Array slowest(&arena);
+	Array all(&arena);
+	all.reserve(files.size());
+
+	// Built twice rather than copied: a copy of a node would not be in the
+	// arena, as Node is not constructed with the allocator of its container
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		if (i < n_slowest) slowest.push_back(ToNode(files[i], &arena));
+		all.push_back(ToNode(files[i], &arena));
+	}
+
+	root[L"Slowest files"] = std::move(slowest);
+	root[L"Files"] = std::move(all);
+
+	std::wofstream ofs(file);
+	if (!ofs.is_open()) return false;
+
+	doc.Print(ofs);
+	return (bool)ofs;
+}
+
+bool RunReport::Merge(const std::vector<std::filesystem::path>& inputs, 
+	const std::filesystem::path& output)
+{
+	RunReport out;
+
+	for (const std::filesystem::path& input : inputs)
+	{
+		std::wifstream ifs(input);
+		if (!ifs.is_open()) return false;
+
+		// Totals and percentiles are worked out again from the per-file records
+		std::pmr::monotonic_buffer_resource arena;
+		try
+		{
+			json::pmr::Document<wchar_t> doc = json::pmr::Load(ifs, &arena);
+			const Dict& root = doc.GetRoot().AsMap();
+
+			// Every shard walks the same folder and plans its own part of it.
+			// Reports from before the two were told apart only have the latter
+			size_t n_found = (size_t)root.at(L"Scripts found").AsInt64();
+			out.n_found_ = std::max(out.n_found_, n_found);
+			out.n_jobs_ += root.count(L"Scripts planned") ? (size_t)root.at(L"Scripts planned").AsInt64() : n_found;
+			// Shards plan side by side
+			out.planning_seconds_ = std::max(out.planning_seconds_, root.at(L"Planning (s)").AsDouble());
+
+			for (const Node& node : root.at(L"Files").AsArray())
+			{
+				out.files_.push_back(FromNode(node));
+			}
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	return out.Save(output);
+}
\ No newline at end of file
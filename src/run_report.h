@@ -0,0 +1,89 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Stages a single merge goes through
+enum class Stage
+{
+	LoadFrontPage,
+	LoadScript,
+	Append,
+	Save,
+	Count
+};
+
+// Where the time and the bytes went for one merged file
+struct FileTiming
+{
+	std::wstring script;
+	std::wstring output;
+	std::array<double, (size_t)Stage::Count> seconds{};
+	uintmax_t bytes_read = 0;
+	uintmax_t bytes_written = 0;
+	bool is_merged = true; // Failed merges are timed too
+
+	double Total() const;
+};
+
+// Adds the time spent in its scope to a stage of a file
+class StageTimer
+{
+private:
+	FileTiming& timing_;
+	Stage stage_;
+	std::chrono::steady_clock::time_point start_;
+
+public:
+	StageTimer(FileTiming& timing, Stage stage) :
+		timing_(timing),
+		stage_(stage),
+		start_(std::chrono::steady_clock::now())
+	{
+	}
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+	~StageTimer()
+	{
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+		timing_.seconds[(size_t)stage_] += elapsed.count();
+	}
+};
+
+// Per-file timings of a run, saved as a JSON report with totals,
+// percentiles and the slowest files
+class RunReport
+{
+private:
+	std::vector<FileTiming> files_;
+	size_t n_found_ = 0; // Scripts the walk found
+	size_t n_jobs_ = 0; // Those of them this shard planned
+	double planning_seconds_ = 0;
+	mutable std::mutex mutex_;
+
+public:
+	static constexpr size_t n_slowest = 10;
+
+	RunReport() = default;
+	~RunReport() = default;
+
+	void Clear();
+	void SetPlanning(size_t n_found, size_t n_jobs, double seconds);
+	void AddPlanning(size_t n_found, size_t n_jobs, double seconds); // For later batches of the same run
+	void Add(FileTiming timing);
+	void SetFailed(const std::wstring& output); // For files that failed after being added
+
+	bool Save(const std::filesystem::path& file) const;
+
+	// Combines the reports of shards into one, as if of a single run
+	static bool Merge(const std::vector<std::filesystem::path>& inputs, 
+		const std::filesystem::path& output);
+
+	static const wchar_t* GetStageName(Stage stage);
+};
\ No newline at end of file
@@ -1,8 +1,23 @@
 #include "script_merger.h"
+#include "directory_watcher.h"
+#include "mapped_file.h"
 #include "messages.h"
+#include "output_writer.h"
+#include "prefetcher.h"
+#include "progress_reporter.h"
+#include "run_report.h"
+#include "worker_pool.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cwctype>
 #include <format>
-#include <fstream>
+#include <map>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include "PoDoFo/podofo.h"
 
@@ -14,6 +29,69 @@
 #define PODOFO_SHARED
 #endif // !PODOFO_SHARED
 
+namespace
+{
+	// A watched file that is still being written
+	struct PendingFile
+	{
+		std::optional<FileStat> stat;
+		std::chrono::steady_clock::time_point changed;
+	};
+
+	using PendingFiles = std::map<std::filesystem::path, PendingFile>;
+
+	void AddPending(PendingFiles& files, const std::filesystem::path& file, 
+		std::chrono::steady_clock::time_point now)
+	{
+		// A directory stands for everything in it
+		std::error_code ec;
+		if (std::filesystem::is_directory(file, ec))
+		{
+			for (const std::filesystem::directory_entry& entry : 
+				std::filesystem::recursive_directory_iterator(file, ec))
+			{
+				if (entry.is_regular_file()) files[entry.path()] = { FileStat::Of(entry), now };
+			}
+		}
+		else files[file] = { FileStat::Of(file), now };
+	}
+
+	// Takes out the files that have not changed for the debounce interval
+	std::vector<std::filesystem::path> TakeSettled(PendingFiles& files, 
+		std::chrono::milliseconds debounce, 
+		std::chrono::steady_clock::time_point now)
+	{
+		std::vector<std::filesystem::path> out;
+
+		for (PendingFiles::iterator pos = files.begin(); pos != files.end(); )
+		{
+			PendingFile& pending = pos->second;
+			if (now - pending.changed < debounce)
+			{
+				++pos;
+				continue;
+			}
+
+			// Notifications may lag behind, or never come from network shares,
+			// so the file is stat'ed once more before it counts as settled
+			std::optional<FileStat> stat = FileStat::Of(pos->first);
+			if (!stat) pos = files.erase(pos);
+			else if (!pending.stat || stat->size != pending.stat->size || stat->mtime != pending.stat->mtime)
+			{
+				pending = { stat, now };
+				++pos;
+			}
+			else
+			{
+				out.push_back(pos->first);
+				pos = files.erase(pos);
+			}
+		}
+
+		return out;
+	}
+}
+
 bool ScriptMerger::IsValidFile(const std::filesystem::directory_entry& file)
 {
 	if (!file.is_regular_file()) return false;
@@ -34,11 +112,11 @@ std::filesystem::path ScriptMerger::ToPath(std::wstring_view path,
 	if (skip_check) return path;
 
 	bool success = true;
-	while (!exists(path))
+	for (size_t attempt = 0; !exists(path); ++attempt)
 	{
 		PostVoidPrompt<wchar_t>("Error while accessing the folder!");
 
-		if (!PostBinaryPrompt<wchar_t>("Would you like to retry?"))
+		if (!PostRetryPrompt<wchar_t>(attempt))
 		{
 			success = false;
 			break;
@@ -54,102 +132,234 @@ bool ScriptMerger::CreatePathIfMissing(const std::filesystem::path& path,
 	using namespace std::filesystem;
 	using namespace messages;
 
-	while (!exists(path))
+	if (exists(path)) return true;
+
+	PostVoidPrompt<wchar_t>("The destination directory for merged files is missing.", os);
+	if (!PostConfirmPrompt<wchar_t>("Would you like the program to try to create it?", true, os)) return false;
+
+	for (size_t attempt = 0; ; ++attempt)
 	{
-		PostVoidPrompt<wchar_t>("The destination directory for merged files is missing.", os);
-		if (!PostBinaryPrompt<wchar_t>("Would you like the program to try to create it?")) return false;
-		create_directory(path);
+		std::error_code ec;
+		create_directories(path, ec);
+		if (exists(path)) return true;
+
+		PostVoidPrompt<wchar_t>("Error while creating the folder!", os);
+		if (!PostRetryPrompt<wchar_t>(attempt, os)) return false;
 	}
+}
 
-	return true;
+MergeJob ScriptMerger::PlanJob(const std::filesystem::directory_entry& script) const
+{
+	MergeJob job;
+	job.script = script.path();
+	job.script_stat = FileStat::Of(script).value_or(FileStat{});
+
+	std::wstring script_file_name = job.script.filename().wstring();
+	std::optional<ScriptPatterns::Match> match = patterns_.Classify(script_file_name);
+	if (match) job.route = pattern_routes_[match->pattern];
+
+	const ScriptRoute& route = routes_[job.route];
+
+	if (id_map_name_.size())
+	{
+		std::optional<std::wstring_view> front_page_leaf = 
+			match ? file_map_.Find(match->id) : std::nullopt;
+
+		if (front_page_leaf) job.front_page = route.front_pages_dir / *front_page_leaf;
+		else job.status = MergeJob::Status::NotInMap;
+	}
+	else job.front_page = route.front_pages_dir / script_file_name;
+
+	if (job.status == MergeJob::Status::Ready &&
+		!GetSnapshot(route.front_pages_dir).Contains(job.front_page.filename().wstring()))
+	{
+		job.status = MergeJob::Status::NoFrontPage;
+	}
+
+	if (job.status == MergeJob::Status::Ready)
+	{
+		job.output = route.output_dir / job.front_page.filename();
+	}
+
+	return job;
 }
 
-void ScriptMerger::ParseMapFile(std::wifstream& ifs)
+void ScriptMerger::MarkDuplicateOutputs()
 {
-	std::wstring Id1;
-	std::wstring Id2;
-	std::wstring script_file_leaf;
+	// Patterns sharing an output directory may map two scripts of a student
+	// to the same file. Neither is merged: one would overwrite the other,
+	// or both would write the same temporary file at once
+	std::unordered_map<std::wstring, size_t> outputs;
+	for (size_t i = 0; i < jobs_.size(); ++i)
+	{
+		MergeJob& job = jobs_[i];
+		if (job.status != MergeJob::Status::Ready) continue;
+
+		// File names are compared the way Windows does, ignoring case
+		std::wstring key = job.output.lexically_normal().wstring();
+		std::transform(key.begin(), key.end(), key.begin(), 
+			[](wchar_t c) { return (wchar_t)std::towlower(c); });
+
+		auto [pos, is_new] = outputs.try_emplace(std::move(key), i);
+		if (is_new) continue;
+
+		job.status = MergeJob::Status::DuplicateOutput;
+		jobs_[pos->second].status = MergeJob::Status::DuplicateOutput;
+	}
+}
 
-	while (std::getline(ifs, Id1))
+void ScriptMerger::MarkUpToDate(WorkerPool& pool)
+{
+	if (!options_.incremental) return;
+
+	// Decided before any input is prefetched, so that skipped pairs are never
+	// read in full. Hashing, if asked for, is spread over the merging threads
+	for (MergeJob& job : jobs_)
 	{
-		script_file_leaf = script_name_pattern_;
+		if (job.status != MergeJob::Status::Ready) continue;
 
-		// Tab has to be the separator
-		size_t pos = Id1.find_first_of('\t');
-		if (pos == std::string::npos) continue;
+		pool.Submit([this, &job]
+			{
+				const ScriptRoute& route = routes_[job.route];
+				std::wstring key = GetManifestKey(job);
+				std::optional<MergeManifest::Entry> previous = manifest_.Find(key);
 
-		Id2 = Id1.substr(pos + 1);
-		Id1 = Id1.substr(0, pos);
+				FileStat front_page_stat = GetSnapshot(route.front_pages_dir).Find(
+					job.front_page.filename().wstring()).value_or(FileStat{});
 
-		// Turn Id1 into the file name by inserting it at '*' in the mask.
-		// If there is no '*', Id1 is simply prepended by the mask.
-		pos = script_file_leaf.find_first_of('*');
-		if (pos != std::string::npos)
-		{
-			script_file_leaf = script_file_leaf.replace(pos, 1, Id1) + L".pdf";
-		}
-		else script_file_leaf += std::move(Id1);
+				if (options_.hash_inputs)
+				{
+					job.inputs.script = Fingerprint::Take(job.script, job.script_stat, 
+						previous ? &previous->script : nullptr);
+					job.inputs.front_page = Fingerprint::Take(job.front_page, front_page_stat, 
+						previous ? &previous->front_page : nullptr);
+				}
+				else job.inputs = { job.script_stat, front_page_stat };
 
-		file_map_[script_file_leaf] = Id2 + L".pdf";
+				if (previous && 
+					GetSnapshot(route.output_dir).Contains(job.output.filename().wstring()) &&
+					job.inputs.script.Matches(previous->script) &&
+					job.inputs.front_page.Matches(previous->front_page))
+				{
+					job.status = MergeJob::Status::UpToDate;
+
+					// Mtimes vouched for by the hash are stored, so they are not hashed again
+					manifest_.Record(std::move(key), job.inputs);
+				}
+			});
 	}
+
+	pool.Wait();
 }
 
-size_t ScriptMerger::GetFileTotal() const
+void ScriptMerger::TakeSnapshots(bool of_outputs)
 {
-	using namespace std::filesystem;
-	size_t out = 0;
+	for (const ScriptRoute& route : routes_)
+	{
+		const std::filesystem::path& dir = of_outputs ? route.output_dir : route.front_pages_dir;
+		snapshots_[dir].Take(dir);
+	}
+}
 
-	for (const directory_entry& file :
-		recursive_directory_iterator(scripts_dir_))
+DirectorySnapshot& ScriptMerger::GetSnapshot(const std::filesystem::path& dir)
+{
+	// Never inserts, so that merging threads can share the map
+	return snapshots_.at(dir);
+}
+
+const DirectorySnapshot& ScriptMerger::GetSnapshot(const std::filesystem::path& dir) const
+{
+	return snapshots_.at(dir);
+}
+
+std::wstring ScriptMerger::GetManifestKey(const MergeJob& job) const
+{
+	// Output names alone may repeat across the output directories of routes
+	std::filesystem::path key = job.output.lexically_relative(output_dir_);
+	return key.empty() ? job.output.wstring() : key.wstring();
+}
+
+std::filesystem::path ScriptMerger::GetManifestPath() const
+{
+	// Shards sharing the output folder keep manifests of their own
+	std::wstring name = MergeManifest::file_name;
+	if (options_.n_shards > 1)
 	{
-		out += IsValidFile(file) ? 1 : 0;
+		name.insert(name.rfind(L'.'), std::format(L".{0}of{1}", options_.shard + 1, options_.n_shards));
 	}
 
-	return out;
+	return output_dir_ / name;
 }
 
-void ScriptMerger::MergePDFs(const std::filesystem::path& script, 
-	const std::filesystem::path& front_page, 
-	std::wostream& os)
+bool ScriptMerger::IsInShard(const std::filesystem::path& script) const
 {
-	using namespace std::filesystem;
-	using namespace messages;
+	if (options_.n_shards <= 1) return true;
 
-	path new_script = output_dir_ / front_page.filename();
+	// Scripts split by bytes stay with the shard the listing gave them to
+	auto pos = byte_shards_.find(script);
+	if (pos != byte_shards_.end()) return pos->second;
 
-	// Remove the merged file if it is already there
-	if (exists(new_script))
+	// Hashed relative to the scripts folder, so that every machine gets the
+	// same value whatever the share is mounted as
+	std::u8string name = script.lexically_relative(scripts_dir_).generic_u8string();
+	return Fingerprint::Hash({ (const char*)name.data(), name.size() }) % options_.n_shards == options_.shard;
+}
+
+void ScriptMerger::ShardJobs()
+{
+	byte_shards_.clear();
+	if (options_.n_shards <= 1) return;
+
+	std::vector<bool> is_kept(jobs_.size());
+	if (options_.shard_by_bytes)
 	{
-		while (!remove(new_script))
+		// Largest scripts first, each to the least loaded shard. Every instance
+		// lists the same folder, so all of them arrive at the same split
+		std::vector<std::wstring> names(jobs_.size());
+		for (size_t i = 0; i < jobs_.size(); ++i)
 		{
-			PostVoidPrompt<wchar_t>("Error while trying to replace the old merged file!", os);
+			names[i] = jobs_[i].script.lexically_relative(scripts_dir_).generic_wstring();
+		}
 
-			if (!PostBinaryPrompt<wchar_t>("Would you like to retry?", os))
+		std::vector<size_t> order(jobs_.size());
+		std::iota(order.begin(), order.end(), (size_t)0);
+		std::sort(order.begin(), order.end(), [this, &names](size_t lhs, size_t rhs)
 			{
-				PostVoidPrompt<wchar_t>("Giving up on the file...");
-				return;
-			}
+				uintmax_t lhs_size = jobs_[lhs].script_stat.size;
+				uintmax_t rhs_size = jobs_[rhs].script_stat.size;
+				return lhs_size != rhs_size ? lhs_size > rhs_size : names[lhs] < names[rhs];
+			});
+
+		std::vector<uintmax_t> shard_bytes(options_.n_shards);
+		for (size_t i : order)
+		{
+			size_t shard = std::min_element(shard_bytes.begin(), shard_bytes.end()) - shard_bytes.begin();
+			shard_bytes[shard] += jobs_[i].script_stat.size;
+			is_kept[i] = shard == options_.shard;
+			byte_shards_[jobs_[i].script] = is_kept[i];
 		}
 	}
+	else
+	{
+		for (size_t i = 0; i < jobs_.size(); ++i) is_kept[i] = IsInShard(jobs_[i].script);
+	}
 
-	PoDoFo::PdfMemDocument old_pdf;
-	PoDoFo::PdfMemDocument new_pdf;
-
-	new_pdf.Load(front_page.string());
-	old_pdf.Load(script.string());
-	new_pdf.GetPages().AppendDocumentPages(old_pdf);
-
-	new_pdf.Save(new_script.string());
-
-	if (exists(new_script)) PostVoidPrompt<wchar_t>("File is formed and saved!", os);
-	else PostVoidPrompt<wchar_t>("Unknown error while saving the file.", os);
+	// Keeping the order of the walk
+	size_t n_kept = 0;
+	for (size_t i = 0; i < jobs_.size(); ++i)
+	{
+		if (is_kept[i]) jobs_[n_kept++] = std::move(jobs_[i]);
+	}
+	jobs_.erase(jobs_.begin() + n_kept, jobs_.end());
 }
 
 ScriptMerger::ScriptMerger(std::wstring_view scripts_dir,
 	std::wstring_view front_pages_dir,
 	std::wstring_view output_dir,
 	std::wstring_view script_name_pattern,
-	std::wstring_view file_map_name)
+	std::wstring_view file_map_name,
+	const MergeOptions& options) :
+	options_(options)
 {
 	scripts_dir_ = ToPath(scripts_dir);
 	if (scripts_dir_.empty()) goto MISSING_PATH;
@@ -160,6 +370,7 @@ ScriptMerger::ScriptMerger(std::wstring_view scripts_dir,
 	output_dir_ = ToPath(output_dir, true);
 	script_name_pattern_ = script_name_pattern;
 	id_map_name_ = file_map_name;
+	SetRoutes({});
 
 	return;
 
@@ -167,22 +378,77 @@ MISSING_PATH:
 	is_good_ = false;
 }
 
-void ScriptMerger::ReadIdMap()
+ScriptMerger::~ScriptMerger() = default;
+
+bool ScriptMerger::SetRoutes(std::vector<ScriptRoute> routes)
+{
+	routes_.assign(1, { script_name_pattern_, front_pages_dir_, output_dir_ });
+	pattern_routes_.clear();
+	patterns_.Clear();
+
+	// Without routes of its own, the single pattern routes to the defaults
+	if (routes.empty())
+	{
+		patterns_.Add(script_name_pattern_);
+		pattern_routes_.push_back(0);
+		return true;
+	}
+
+	for (ScriptRoute& route : routes)
+	{
+		if (!patterns_.Add(route.pattern)) return false;
+
+		if (route.front_pages_dir.empty()) route.front_pages_dir = front_pages_dir_;
+		if (route.output_dir.empty()) route.output_dir = output_dir_;
+
+		pattern_routes_.push_back(routes_.size());
+		routes_.push_back(std::move(route));
+	}
+
+	return true;
+}
+
+bool ScriptMerger::ReadIdMap()
 {
 	using namespace std::string_view_literals;
 	using namespace messages;
 	
 	// Skip the step if there is no Id map file
-	if (id_map_name_.empty()) return;
+	if (id_map_name_.empty()) return true;
+
+	std::filesystem::path map_path = L".//" + id_map_name_;
+	std::filesystem::path cache_path = map_path;
+	cache_path += L".cache";
 
-	std::wifstream ifs(L".//" + id_map_name_);
+	// A cache compiled from a map file of the same size and time is used
+	// as is, straight from the mapping, with nothing parsed
+	IdTable::Source cached;
+	bool is_cached = file_map_.LoadCache(cache_path, cached);
+
+	std::optional<FileStat> map_stat = FileStat::Of(map_path);
+	Fingerprint current = map_stat.value_or(FileStat{});
+	if (is_cached && map_stat && 
+		cached.size == current.size && cached.mtime == current.mtime)
+	{
+		return true;
+	}
+
+	MappedFile map_file;
 
 	bool success = true;
-	while (!ifs.is_open())
+	for (size_t attempt = 0; !map_file.Open(map_path); ++attempt)
 	{
+		// An empty file cannot be mapped, but there is nothing to read from it either
+		std::error_code ec;
+		if (!std::filesystem::file_size(map_path, ec) && !ec)
+		{
+			file_map_.Clear();
+			return true;
+		}
+
 		PostVoidPrompt<wchar_t>("Error while trying to open the map file!");
 
-		if (!PostBinaryPrompt<wchar_t>("Would you like to retry?"))
+		if (!PostRetryPrompt<wchar_t>(attempt))
 		{
 			success = false;
 			break;
@@ -190,83 +456,572 @@ void ScriptMerger::ReadIdMap()
 	}
 	if (!success)
 	{
+		file_map_.Clear();
+		if (is_run_failed) return false;
+
 		PostVoidPrompt<wchar_t>("Skipping the map file...");
-		return;
+		return true;
+	}
+
+	// A touched but unchanged map file only costs hashing it, and the cache
+	// is saved again just to record the new time
+	current = FileStat::Of(map_path).value_or(FileStat{});
+	IdTable::Source source{ (uint64_t)current.size, current.mtime, 
+		Fingerprint::Hash(map_file.View()) };
+
+	if (!is_cached || cached.size != source.size || cached.hash != source.hash)
+	{
+		file_map_.Clear();
+		// Keyed by the bare email Id, which patterns_ extract from file names
+		file_map_.InsertLines(map_file.View(), L".pdf");
 	}
 
-	ParseMapFile(ifs);
+	if (!file_map_.SaveCache(cache_path, source))
+	{
+		PostVoidPrompt<wchar_t>("Error while saving the map cache! The map file will be read again next time.");
+	}
+
+	return true;
 }
 
-void ScriptMerger::ProcessPDFs(std::wostream& os)
+void ScriptMerger::PlanJobs()
+{
+	using namespace std::filesystem;
+
+	// Front pages are resolved against snapshots rather than stat'ed one by one
+	TakeSnapshots(false);
+
+	// The only walk over the scripts tree, everything else uses the job list
+	jobs_.clear();
+	for (const directory_entry& script :
+		recursive_directory_iterator(scripts_dir_))
+	{
+		if (IsValidFile(script)) jobs_.push_back(PlanJob(script));
+	}
+
+	MarkDuplicateOutputs();
+}
+
+bool ScriptMerger::ProcessPDFs(std::wostream& os)
 {
 	using namespace std::filesystem;
 	using namespace messages;
 
 	PostVoidPrompt<wchar_t>("Processing started...", os);
+	n_failed_ = 0;
 
 	// Retrieving the script total
-	size_t n_files = GetFileTotal();
-	PostVoidPrompt<wchar_t>(std::format(L"{0} pdf files found in the folder.", n_files), os);
+	std::chrono::steady_clock::time_point planning_start = std::chrono::steady_clock::now();
+	PlanJobs();
+	size_t n_found = jobs_.size();
+	ShardJobs();
+	size_t n_files = jobs_.size();
+
+	report_.Clear();
+	report_.SetPlanning(n_found, n_files, std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - planning_start).count());
+
+	PostVoidPrompt<wchar_t>(std::format(L"{0} pdf files found in the folder.", n_found), os);
+	if (options_.n_shards > 1)
+	{
+		PostVoidPrompt<wchar_t>(std::format(L"{0} of them belong to shard {1}/{2}.", 
+			n_files, options_.shard + 1, options_.n_shards), os);
+	}
+	return RunJobs(os);
+}
+
+bool ScriptMerger::RunJobs(std::wostream& os)
+{
+	using namespace std::filesystem;
+	using namespace messages;
 
-	// Creating the output folder if it is missing
-	if (!CreatePathIfMissing(output_dir_, os)) return;
+	size_t n_files = jobs_.size();
+
+	// Creating the output folders if they are missing
+	for (const ScriptRoute& route : routes_)
+	{
+		if (!CreatePathIfMissing(route.output_dir, os)) return false;
+	}
+
+	// Only the output folders of these jobs are listed again, as a watch
+	// batch is often a single file
+	std::set<path> output_dirs;
+	for (const MergeJob& job : jobs_) output_dirs.insert(routes_[job.route].output_dir);
+	for (const path& dir : output_dirs) snapshots_[dir].Take(dir);
+
+	// Inputs of the previous run are only needed when skipping unchanged ones
+	if (options_.incremental) manifest_.Load(GetManifestPath());
 	
-	// Merging files with front pages
-	size_t i = 1;
-	for (const directory_entry& script : 
-		recursive_directory_iterator(scripts_dir_))
+	// Merging files with front pages, each one as a separate task
+	size_t n_threads = options_.thread_count ? options_.thread_count :
+		std::max(std::thread::hardware_concurrency(), 1u);
+	PostVoidPrompt<wchar_t>(std::format(L"Merging with {0} thread(s).", n_threads), os);
+
+	WorkerPool pool(n_threads);
+	MarkUpToDate(pool);
+
+	// Reading inputs ahead of the merging threads, up to date ones excluded
+	if (options_.prefetch_depth)
+	{
+		prefetcher_ = std::make_unique<Prefetcher>(jobs_, 
+			options_.prefetch_depth, options_.prefetch_budget);
+	}
+
+	// Saving merged files off the merging threads
+	if (options_.writer_threads)
 	{
-		if (!IsValidFile(script)) continue;
+		writer_ = std::make_unique<OutputWriter>(options_.writer_threads, 
+			options_.write_queue, options_.sync_batch);
+	}
+
+	// With the status line up, per-file messages go to the log, if any
+	LogSink log;
+	if (options_.progress && !options_.log_file.empty() && !log.Open(options_.log_file))
+	{
+		PostVoidPrompt<wchar_t>("Error while opening the log file!", os);
+	}
 
-		PostVoidPrompt<wchar_t>(std::format(L"Attaching the front page to file {0} out of {1}:", 
-			i, n_files), os);
+	OrderedOutput output(options_.progress ? log.Stream() : os, n_files);
+	if (options_.progress) progress_ = std::make_unique<ProgressReporter>(os, n_files);
 
+	for (size_t i = 0; i < n_files; ++i)
+	{
+		pool.Submit([this, &output, i, n_files]
+			{
+				std::wostringstream oss;
+				bool is_merged = ProcessJob(i, n_files, oss);
+				output.Post(i, oss.str());
+				if (progress_) progress_->OnFileDone(jobs_[i].script_stat.size, is_merged);
+			});
+	}
 
-		path front_page;
+	pool.Wait();
+	prefetcher_.reset();
 
-		if (id_map_name_.size())
+	// Writer threads may still count failures on the status line
+	if (writer_)
+	{
+		writer_->Close();
+		writer_.reset();
+	}
+
+	if (progress_)
+	{
+		progress_->Finish();
+		progress_.reset();
+	}
+
+	for (const std::wstring& output_name : write_errors_)
+	{
+		PostVoidPrompt<wchar_t>(std::format(L"Error while saving the file {0}!", output_name), os);
+		if (!options_.report_file.empty()) report_.SetFailed(output_name);
+	}
+	n_failed_ += write_errors_.size();
+	write_errors_.clear();
+
+	if (options_.incremental &&
+		!manifest_.Save(GetManifestPath()))
+	{
+		PostVoidPrompt<wchar_t>("Error while saving the merge manifest!", os);
+	}
+
+	if (!options_.report_file.empty())
+	{
+		if (report_.Save(options_.report_file))
 		{
-			std::wstring script_file_name = script.path().filename().wstring();
+			PostVoidPrompt<wchar_t>(std::format(L"The run report is saved to {0}.", 
+				options_.report_file.wstring()), os);
+		}
+		else PostVoidPrompt<wchar_t>("Error while saving the run report!", os);
+	}
 
-			IdMap::const_iterator pos = file_map_.find(script_file_name);
+	// A merge failed under the "fail" error policy
+	return !is_run_failed;
+}
 
-			if (pos != file_map_.end()) front_page = front_pages_dir_ / pos->second;
-			else
+void ScriptMerger::RefreshFrontPage(const std::filesystem::path& dir, 
+	const std::filesystem::path& file)
+{
+	auto pos = snapshots_.find(dir);
+	if (pos == snapshots_.end()) return;
+
+	// The whole directory is reported when events were dropped
+	if (file == dir)
+	{
+		pos->second.Take(dir);
+		return;
+	}
+
+	// Front pages are looked for directly in their directory only
+	std::filesystem::path name = file.lexically_relative(dir);
+	if (name.empty() || name.has_parent_path() || name == L".") return;
+
+	std::optional<FileStat> stat = FileStat::Of(file);
+	if (stat) pos->second.Insert(name.wstring(), *stat);
+	else pos->second.Erase(name.wstring());
+}
+
+bool ScriptMerger::Watch(std::chrono::milliseconds debounce, 
+	const std::function<bool()>& is_stopping, 
+	std::wostream& os)
+{
+	using namespace std::filesystem;
+	using namespace messages;
+	using clock = std::chrono::steady_clock;
+
+	// Subscribed before the first run, so that nothing arriving during it is missed.
+	// Root 0 is the scripts tree, the rest are front page directories
+	DirectoryWatcher watcher;
+	std::vector<path> watched{ scripts_dir_ };
+	for (const ScriptRoute& route : routes_)
+	{
+		if (std::find(watched.begin(), watched.end(), route.front_pages_dir) == watched.end())
+		{
+			watched.push_back(route.front_pages_dir);
+		}
+	}
+
+	for (const path& dir : watched)
+	{
+		if (!watcher.Add(dir))
+		{
+			PostVoidPrompt<wchar_t>(std::format(L"Error while watching the folder {0}!", dir.wstring()), os);
+			return false;
+		}
+	}
+
+	if (!ProcessPDFs(os)) return false;
+
+	// Scripts that have no front page or Id yet are planned again whenever
+	// a front page settles or another batch is merged.  Those that have one
+	// are merged again when it is replaced
+	std::set<path> waiting;
+	std::map<path, std::set<path>> front_page_scripts;
+	for (const MergeJob& job : jobs_)
+	{
+		if (job.status == MergeJob::Status::NotInMap || 
+			job.status == MergeJob::Status::NoFrontPage)
+		{
+			waiting.insert(job.script);
+		}
+
+		if (!job.front_page.empty()) front_page_scripts[job.front_page].insert(job.script);
+	}
+
+	PendingFiles scripts;
+	PendingFiles front_pages;
+	std::chrono::milliseconds timeout = std::min(debounce, std::chrono::milliseconds(250));
+
+	PostVoidPrompt<wchar_t>("Watching for new scripts...", os);
+	while (!is_stopping())
+	{
+		clock::time_point now = clock::now();
+		for (const DirectoryWatcher::Change& change : watcher.Wait(timeout))
+		{
+			// Snapshots follow front pages as they change, deletions included
+			if (change.root) RefreshFrontPage(watched[change.root], change.file);
+			AddPending(change.root ? front_pages : scripts, change.file, now);
+		}
+
+		now = clock::now();
+		std::vector<path> settled_scripts = TakeSettled(scripts, debounce, now);
+		std::vector<path> settled_front_pages = TakeSettled(front_pages, debounce, now);
+		if (settled_scripts.empty() && settled_front_pages.empty()) continue;
+
+		std::set<path> settled(settled_scripts.begin(), settled_scripts.end());
+		for (const path& front_page : settled_front_pages)
+		{
+			for (const path& dir : watched)
 			{
-				PostVoidPrompt<wchar_t>("Cannot find the front page! An error in the mapping file.",
-					os, true);
-				continue;
+				RefreshFrontPage(dir, front_page);
 			}
+
+			auto pos = front_page_scripts.find(front_page);
+			if (pos != front_page_scripts.end()) settled.insert(pos->second.begin(), pos->second.end());
 		}
-		else front_page = script;
 
-		if (!exists(front_page))
+		settled.insert(waiting.begin(), waiting.end());
+		waiting.clear();
+
+		// A roster updated during marking is picked up too
+		if (!ReadIdMap()) return false;
+
+		jobs_.clear();
+		for (const path& script : settled)
 		{
-			PostVoidPrompt<wchar_t>("Cannot find the front page! The file is missing.",
-				os, true);
-			continue;
+			std::error_code ec;
+			directory_entry entry(script, ec);
+			// Byte balancing needs the whole listing, so only arrivals are split by name
+			if (ec || !IsValidFile(entry) || !IsInShard(script)) continue;
+
+			MergeJob job = PlanJob(entry);
+			if (!job.front_page.empty()) front_page_scripts[job.front_page].insert(script);
+
+			if (job.status != MergeJob::Status::Ready)
+			{
+				waiting.insert(script);
+				continue;
+			}
+
+			// The front page is still being written
+			if (front_pages.count(job.front_page))
+			{
+				scripts[script] = { job.script_stat, now };
+				continue;
+			}
+
+			jobs_.push_back(std::move(job));
 		}
 
-		// Merging pdfs
+		if (jobs_.empty()) continue;
+		MarkDuplicateOutputs();
+
+		PostVoidPrompt<wchar_t>(std::format(L"{0} new or changed pdf file(s) to merge.", jobs_.size()), os);
+		// The report covers the whole session, so it keeps the first run too
+		report_.AddPlanning(jobs_.size(), jobs_.size(), 0);
+
+		if (!RunJobs(os)) return false;
+		PostVoidPrompt<wchar_t>(std::format(L"{0} file(s) waiting for a front page or an Id.", waiting.size()), os);
+	}
+
+	return true;
+}
+
+bool ScriptMerger::ProcessJob(size_t i, size_t n_files, 
+	std::wostream& os)
+{
+	using namespace std::filesystem;
+	using namespace messages;
+
+	const MergeJob& job = jobs_[i];
+
+	PostVoidPrompt<wchar_t>(std::format(L"Attaching the front page to file {0} out of {1}:", 
+		i + 1, n_files), os);
+
+	if (job.status == MergeJob::Status::NotInMap)
+	{
+		PostVoidPrompt<wchar_t>("Cannot find the front page! An error in the mapping file.",
+			os, true);
+		++n_failed_;
+		return false;
+	}
+
+	if (job.status == MergeJob::Status::NoFrontPage)
+	{
+		PostVoidPrompt<wchar_t>("Cannot find the front page! The file is missing.",
+			os, true);
+		++n_failed_;
+		return false;
+	}
+
+	if (job.status == MergeJob::Status::DuplicateOutput)
+	{
+		PostVoidPrompt<wchar_t>(std::format(L"Another script is to be merged into {0} too! "
+			L"Give the patterns output directories of their own.", job.output.wstring()),
+			os, true);
+		++n_failed_;
+		return false;
+	}
+
+	if (job.status == MergeJob::Status::UpToDate)
+	{
+		PostVoidPrompt<wchar_t>("The merged file is up to date, skipping.", os);
+		return true;
+	}
+
+	const ScriptRoute& route = routes_[job.route];
+	std::optional<FileStat> front_page_stat = 
+		GetSnapshot(route.front_pages_dir).Find(job.front_page.filename().wstring());
+	// Another merge failed under the "fail" error policy
+	if (is_run_failed)
+	{
+		PostVoidPrompt<wchar_t>("The run is stopping, not merging the file.", os);
+		return false;
+	}
+
+	PrefetchedInputs prefetched;
+	if (prefetcher_) prefetched = prefetcher_->Take(i);
+
+	bool is_reporting = !options_.report_file.empty();
+
+	FileTiming timing;
+	timing.script = job.script.wstring();
+	timing.output = job.output.wstring();
+	timing.bytes_read = job.script_stat.size + front_page_stat.value_or(FileStat{}).size;
+
+	// Merging pdfs.  In batch mode a failed merge follows the error policy;
+	// prompts cannot be answered from the merging threads, so interactive
+	// runs give up on the file at once
+	const wchar_t* message = L"File is formed and saved!";
+	bool is_merged = true;
+	for (size_t attempt = 0; ; ++attempt)
+	{
 		try
 		{
-			PoDoFo::PdfMemDocument old_pdf;
-			PoDoFo::PdfMemDocument new_pdf;
+			// Streamed documents write themselves, so they bypass the writer stage
+			if (options_.streamed_output) MergeStreamed(job, prefetched, timing);
+			else if (writer_)
+			{
+				std::string buffer;
+				MergeInMemory(job, prefetched, timing, &buffer);
+				timing.bytes_written = buffer.size();
 
-			new_pdf.Load(front_page.string());
-			old_pdf.Load(script.path().string());
-			new_pdf.GetPages().AppendDocumentPages(old_pdf);
+				writer_->Submit(job.output, std::move(buffer),
+					[this, &job](bool is_saved)
+					{
+						if (is_saved) OnSaved(job);
+						else
+						{
+							if (progress_) progress_->OnFileFailed();
 
-			path new_script = output_dir_ / front_page.filename();
-			new_pdf.Save(new_script.string());
+							std::lock_guard lock(write_errors_mutex_);
+							write_errors_.push_back(job.output.wstring());
+						}
+					});
 
-			if (exists(new_script))
+				message = L"File is formed and queued for saving!";
+			}
+			else MergeInMemory(job, prefetched, timing);
+
+			if (options_.streamed_output || !writer_)
 			{
-				PostVoidPrompt<wchar_t>("File is formed and saved!", os);
+				// Costs a stat, so only done when there is a report to fill in
+				if (is_reporting)
+				{
+					timing.bytes_written = FileStat::Of(job.output).value_or(FileStat{}).size;
+				}
+
+				OnSaved(job);
 			}
+
+			break;
 		}
 		catch (const std::exception&)
 		{
+			PostVoidPrompt<wchar_t>("Error while merging the file!", os);
+
+			if (batch_settings.is_batch && PostRetryPrompt<wchar_t>(attempt, os))
+			{
+				// Read from the files this time, and timed afresh
+				prefetched = {};
+				timing.seconds = {};
+				continue;
+			}
+
+			message = L"Giving up on the file...";
+			is_merged = false;
+			timing.is_merged = false;
+			++n_failed_;
+			break;
+		}
+	}
+
+	// Failed merges are reported too, with whatever time they took
+	if (is_reporting) report_.Add(std::move(timing));
+	PostVoidPrompt<wchar_t>(message, os);
+
+	return is_merged;
+}
+
+void ScriptMerger::OnSaved(const MergeJob& job)
+{
+	if (options_.incremental) manifest_.Record(GetManifestKey(job), job.inputs);
+	GetSnapshot(routes_[job.route].output_dir).Insert(job.output.filename().wstring());
+}
+
+void ScriptMerger::LoadInput(PoDoFo::PdfMemDocument& pdf, 
+	const std::filesystem::path& file, 
+	const std::string& prefetched,
+	MappedFile& mapping) const
+{
+	// Buffers have to outlive the document, which may read from them lazily
+	if (!prefetched.empty())
+	{
+		pdf.LoadFromBuffer(PoDoFo::bufferview(prefetched.data(), prefetched.size()));
+	}
+	else if (options_.mapped_input && mapping.Open(file))
+	{
+		pdf.LoadFromBuffer(PoDoFo::bufferview(mapping.Data(), mapping.Size()));
+	}
+	else pdf.Load(file.string());
+}
+
+void ScriptMerger::MergeInMemory(const MergeJob& job, 
+	const PrefetchedInputs& prefetched, 
+	FileTiming& timing, 
+	std::string* buffer) const
+{
+	MappedFile old_mapping;
+	MappedFile new_mapping;
+	PoDoFo::PdfMemDocument old_pdf;
+	PoDoFo::PdfMemDocument new_pdf;
+
+	{
+		StageTimer timer(timing, Stage::LoadFrontPage);
+		LoadInput(new_pdf, job.front_page, prefetched.front_page, new_mapping);
+	}
+
+	{
+		StageTimer timer(timing, Stage::LoadScript);
+		LoadInput(old_pdf, job.script, prefetched.script, old_mapping);
+	}
+
+	{
+		StageTimer timer(timing, Stage::Append);
+		new_pdf.GetPages().AppendDocumentPages(old_pdf);
+	}
+
+	StageTimer timer(timing, Stage::Save);
+	if (buffer)
+	{
+		PoDoFo::StringStreamDevice device(*buffer);
+		new_pdf.Save(device);
+	}
+	else new_pdf.Save(job.output.string());
+}
+
+void ScriptMerger::MergeStreamed(const MergeJob& job, 
+	const PrefetchedInputs& prefetched, 
+	FileTiming& timing) const
+{
+	// Objects are written out as they are added, and each input document
+	// is released as soon as its pages have been copied over
+	try
+	{
+		PoDoFo::PdfStreamedDocument new_pdf(job.output.string());
+
+		{
+			MappedFile front_mapping;
+			PoDoFo::PdfMemDocument front_pdf;
+			{
+				StageTimer timer(timing, Stage::LoadFrontPage);
+				LoadInput(front_pdf, job.front_page, prefetched.front_page, front_mapping);
+			}
+
+			StageTimer timer(timing, Stage::Append);
+			new_pdf.GetPages().AppendDocumentPages(front_pdf);
+		}
+
+		{
+			MappedFile old_mapping;
+			PoDoFo::PdfMemDocument old_pdf;
+			{
+				StageTimer timer(timing, Stage::LoadScript);
+				LoadInput(old_pdf, job.script, prefetched.script, old_mapping);
+			}
+
+			StageTimer timer(timing, Stage::Append);
+			new_pdf.GetPages().AppendDocumentPages(old_pdf);
 		}
+
+		StageTimer timer(timing, Stage::Save);
+		new_pdf.Close();
+	}
+	catch (...)
+	{
+		// Not leaving a truncated file behind
+		std::error_code ec;
+		std::filesystem::remove(job.output, ec);
+		throw;
 	}
 }
\ No newline at end of file
@@ -1,20 +1,110 @@
 #pragma once
+#include "directory_snapshot.h"
+#include "id_table.h"
+#include "merge_manifest.h"
+#include "run_report.h"
+#include "script_pattern.h"
+
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <map>
 #include <string>
-#include <unordered_map>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class MappedFile;
+class OutputWriter;
+class Prefetcher;
+class ProgressReporter;
+class WorkerPool;
+struct PrefetchedInputs;
+
+namespace PoDoFo
+{
+	class PdfMemDocument;
+}
+
+// Tuning of the merging process
+struct MergeOptions
+{
+	size_t thread_count = 1; // 0 stands for the number of hardware threads
+	bool incremental = false; // Skip outputs whose inputs have not changed
+	bool hash_inputs = false; // Compare the contents of inputs, not just sizes and times
+	bool streamed_output = false; // Write merged files as they are built
+	bool mapped_input = false; // Load inputs from memory-mapped files
+	size_t prefetch_depth = 0; // Number of jobs whose inputs are read ahead, 0 to disable
+	uintmax_t prefetch_budget = 512ull << 20; // Bytes the read-ahead inputs may take up
+	size_t writer_threads = 0; // Threads saving merged files, 0 to save on the merging ones
+	size_t write_queue = 8; // Merged files that may wait for a writer thread
+	size_t sync_batch = 0; // Merged files fsync'ed together, 0 to leave it to the system
+	std::filesystem::path report_file; // JSON report with stage timings, none if empty
+	bool progress = false; // A single status line instead of per-file messages
+	std::filesystem::path log_file; // Per-file messages while the status line is up, none if empty
+	size_t shard = 0; // Part of the jobs merged by this instance, counted from 0
+	size_t n_shards = 1; // Instances splitting the jobs between them, 1 for all jobs
+	bool shard_by_bytes = false; // Balance script bytes rather than hash script names
+};
+
+// Scripts matching a name pattern and the directories they are routed to
+struct ScriptRoute
+{
+	std::wstring pattern;
+	std::filesystem::path front_pages_dir; // Empty for the default one
+	std::filesystem::path output_dir; // Empty for the default one
+};
+
+// A single front page/script pair planned for merging
+struct MergeJob
+{
+	enum class Status
+	{
+		Ready,
+		NotInMap, // The script name has no entry in the Id map
+		NoFrontPage, // The front page file is missing
+		DuplicateOutput, // Another script is to be merged into the same file
+		UpToDate // Neither half has changed since the last incremental run
+	};
+
+	std::filesystem::path script;
+	std::filesystem::path front_page;
+	std::filesystem::path output;
+	FileStat script_stat;
+	size_t route = 0; // Index of the route the script was matched to
+	Status status = Status::Ready;
+	MergeManifest::Entry inputs; // Filled in by incremental runs only
+};
 
 class ScriptMerger
 {
 private:
-	using IdMap = std::unordered_map<std::wstring, std::wstring>;
-
 	std::filesystem::path scripts_dir_;
 	std::filesystem::path front_pages_dir_;
 	std::filesystem::path output_dir_;
 	std::wstring script_name_pattern_;
 	std::wstring id_map_name_;
-	IdMap file_map_;
+
+	// Route 0 has the default directories, taken when no pattern matches
+	std::vector<ScriptRoute> routes_;
+	std::vector<size_t> pattern_routes_;
+	ScriptPatterns patterns_;
+
+	IdTable file_map_;
+	std::vector<MergeJob> jobs_;
+	std::map<std::filesystem::path, bool> byte_shards_; // Listed scripts, whether this shard got them
+	std::map<std::filesystem::path, DirectorySnapshot> snapshots_;
+	MergeManifest manifest_;
+	std::unique_ptr<Prefetcher> prefetcher_;
+	std::unique_ptr<OutputWriter> writer_;
+	std::unique_ptr<ProgressReporter> progress_;
+	std::vector<std::wstring> write_errors_;
+	std::mutex write_errors_mutex_;
+	std::atomic<size_t> n_failed_ = 0; // Files of the last run that were not merged
+	RunReport report_;
+	MergeOptions options_;
 	bool is_good_ = true;
 
 	static bool IsValidFile(const std::filesystem::directory_entry&);
@@ -23,10 +113,34 @@ private:
 	static bool CreatePathIfMissing(const std::filesystem::path& path, 
 		std::wostream& os);
 
-	void ParseMapFile(std::wifstream&);
-	size_t GetFileTotal() const;
-	void MergePDFs(const std::filesystem::path& script,
-		const std::filesystem::path& front_page, 
+	void TakeSnapshots(bool of_outputs);
+	DirectorySnapshot& GetSnapshot(const std::filesystem::path& dir);
+	const DirectorySnapshot& GetSnapshot(const std::filesystem::path& dir) const;
+	std::wstring GetManifestKey(const MergeJob& job) const;
+	std::filesystem::path GetManifestPath() const;
+	bool IsInShard(const std::filesystem::path& script) const;
+	void RefreshFrontPage(const std::filesystem::path& dir, 
+		const std::filesystem::path& file);
+	void ShardJobs();
+	MergeJob PlanJob(const std::filesystem::directory_entry& script) const;
+	void MarkDuplicateOutputs();
+	void MarkUpToDate(WorkerPool& pool);
+	void LoadInput(PoDoFo::PdfMemDocument& pdf, 
+		const std::filesystem::path& file, 
+		const std::string& prefetched, 
+		MappedFile& mapping) const;
+	void MergeInMemory(const MergeJob& job, 
+		const PrefetchedInputs& prefetched, 
+		FileTiming& timing, 
+		std::string* buffer = nullptr) const;
+	void MergeStreamed(const MergeJob& job, 
+		const PrefetchedInputs& prefetched, 
+		FileTiming& timing) const;
+	void OnSaved(const MergeJob& job);
+	// Merges the jobs planned so far, false if the run is to stop
+	bool RunJobs(std::wostream& os);
+	// False if the file was not merged
+	bool ProcessJob(size_t i, size_t n_files, 
 		std::wostream& os);
 
 public:
@@ -35,11 +149,25 @@ public:
 		std::wstring_view front_pages_dir, 
 		std::wstring_view output_dir, 
 		std::wstring_view script_name_pattern, 
-		std::wstring_view id_map_path);
-	~ScriptMerger() = default;
+		std::wstring_view id_map_path, 
+		const MergeOptions& options = {});
+	~ScriptMerger();
 
 	bool IsGood() const { return is_good_; }
 
-	void ReadIdMap();
-	void ProcessPDFs(std::wostream& os = std::wcout);
+	// Replaces the single script name pattern, first match wins
+	bool SetRoutes(std::vector<ScriptRoute> routes);
+
+	// False if the run is to stop (see messages::OnError::Fail)
+	bool ReadIdMap();
+	void PlanJobs();
+	const std::vector<MergeJob>& GetJobs() const { return jobs_; }
+	// False if the run could not go ahead
+	bool ProcessPDFs(std::wostream& os = std::wcout);
+	// Processes the PDFs, then merges every pair that arrives later once
+	// neither half has changed for the debounce interval
+	bool Watch(std::chrono::milliseconds debounce, 
+		const std::function<bool()>& is_stopping, 
+		std::wostream& os = std::wcout);
+	size_t GetFailedCount() const { return n_failed_; }
 };
\ No newline at end of file
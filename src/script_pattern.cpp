@@ -0,0 +1,94 @@
+#include "script_pattern.h"
+
+template <typename It>
+void ScriptPatterns::Insert(std::vector<TrieNode>& trie, It begin, It end, size_t pattern)
+{
+	uint32_t node = 0;
+
+	for (; begin != end; ++begin)
+	{
+		uint32_t next = 0;
+		for (const auto& [c, child] : trie[node].children)
+		{
+			if (c == *begin) next = child;
+		}
+
+		if (!next)
+		{
+			next = (uint32_t)trie.size();
+			trie[node].children.emplace_back(*begin, next);
+			trie.emplace_back();
+		}
+
+		node = next;
+	}
+
+	trie[node].ends |= uint64_t(1) << pattern;
+}
+
+template <typename It>
+uint64_t ScriptPatterns::Walk(const std::vector<TrieNode>& trie, It begin, It end)
+{
+	uint32_t node = 0;
+	uint64_t out = trie[node].ends;
+
+	for (; begin != end; ++begin)
+	{
+		uint32_t next = 0;
+		for (const auto& [c, child] : trie[node].children)
+		{
+			if (c == *begin) next = child;
+		}
+
+		if (!next) break;
+
+		node = next;
+		out |= trie[node].ends;
+	}
+
+	return out;
+}
+
+bool ScriptPatterns::Add(std::wstring_view pattern)
+{
+	if (lengths_.size() == max_patterns) return false;
+
+	size_t star = pattern.find_first_of('*');
+
+	std::wstring_view prefix = pattern.substr(0, star);
+	std::wstring suffix{ star != std::wstring_view::npos ? 
+		pattern.substr(star + 1) : std::wstring_view{} };
+	suffix += L".pdf";
+
+	Insert(prefixes_, prefix.begin(), prefix.end(), lengths_.size());
+	Insert(suffixes_, suffix.rbegin(), suffix.rend(), lengths_.size());
+	lengths_.emplace_back(prefix.size(), suffix.size());
+
+	return true;
+}
+
+void ScriptPatterns::Clear()
+{
+	prefixes_.assign(1, {});
+	suffixes_.assign(1, {});
+	lengths_.clear();
+}
+
+std::optional<ScriptPatterns::Match> ScriptPatterns::Classify(std::wstring_view file_name) const
+{
+	uint64_t candidates = Walk(prefixes_, file_name.begin(), file_name.end()) &
+		Walk(suffixes_, file_name.rbegin(), file_name.rend());
+
+	for (size_t i = 0; candidates; ++i, candidates >>= 1)
+	{
+		if (!(candidates & 1)) continue;
+
+		// The prefix and the suffix may not overlap, and the Id may not be empty
+		auto [prefix_size, suffix_size] = lengths_[i];
+		if (prefix_size + suffix_size >= file_name.size()) continue;
+
+		return Match{ i, file_name.substr(prefix_size, file_name.size() - prefix_size - suffix_size) };
+	}
+
+	return std::nullopt;
+}
\ No newline at end of file
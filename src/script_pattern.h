@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Script name patterns such as "*-Technical_Assignment" or "Resit_*",
+// compiled together into two tries: one over the literal parts before '*'
+// and one over the (reversed) literal parts after it.  A file name is
+// classified by walking the first from its start and the second from its
+// end, and yields the matching pattern along with the email Id in place
+// of '*' as a view into the name, without building any strings
+class ScriptPatterns
+{
+public:
+	static constexpr size_t max_patterns = 64;
+
+	struct Match
+	{
+		size_t pattern; // Index in the order the patterns were added
+		std::wstring_view id;
+	};
+
+private:
+	struct TrieNode
+	{
+		std::vector<std::pair<wchar_t, uint32_t>> children;
+		uint64_t ends = 0; // Patterns whose literal part ends at this node
+	};
+
+	std::vector<TrieNode> prefixes_{ 1 };
+	std::vector<TrieNode> suffixes_{ 1 };
+	std::vector<std::pair<size_t, size_t>> lengths_; // Of prefixes and suffixes
+
+	template <typename It>
+	static void Insert(std::vector<TrieNode>& trie, It begin, It end, size_t pattern);
+	template <typename It>
+	static uint64_t Walk(const std::vector<TrieNode>& trie, It begin, It end);
+
+public:
+	ScriptPatterns() = default;
+	~ScriptPatterns() = default;
+
+	// Without '*' the whole pattern is a prefix, i.e. the Id comes last.
+	// Returns false once max_patterns have been added
+	bool Add(std::wstring_view pattern);
+	void Clear();
+	size_t Size() const { return lengths_.size(); }
+
+	// The first pattern added wins when several match
+	std::optional<Match> Classify(std::wstring_view file_name) const;
+};
\ No newline at end of file
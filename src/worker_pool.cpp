@@ -0,0 +1,94 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <ostream>
+
+void WorkerPool::Run()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock lock(mutex_);
+			task_ready_.wait(lock, [this] { return is_stopping_ || !tasks_.empty(); });
+			if (tasks_.empty()) return;
+
+			task = std::move(tasks_.front());
+			tasks_.pop();
+		}
+
+		// Tasks are expected to handle their own errors
+		try { task(); }
+		catch (...) {}
+
+		std::lock_guard lock(mutex_);
+		if (!--n_unfinished_) all_done_.notify_all();
+	}
+}
+
+WorkerPool::WorkerPool(size_t n_threads)
+{
+	n_threads = std::max(n_threads, (size_t)1);
+
+	threads_.reserve(n_threads);
+	for (size_t i = 0; i < n_threads; ++i) threads_.emplace_back(&WorkerPool::Run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard lock(mutex_);
+		is_stopping_ = true;
+	}
+
+	task_ready_.notify_all();
+	for (std::thread& thread : threads_) thread.join();
+}
+
+void WorkerPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard lock(mutex_);
+		tasks_.push(std::move(task));
+		++n_unfinished_;
+	}
+
+	task_ready_.notify_one();
+}
+
+void WorkerPool::Wait()
+{
+	std::unique_lock lock(mutex_);
+	all_done_.wait(lock, [this] { return !n_unfinished_; });
+}
+
+OrderedOutput::OrderedOutput(std::wostream& os, size_t n_messages) :
+	os_(os),
+	messages_(n_messages),
+	is_posted_(n_messages, false)
+{
+}
+
+void OrderedOutput::Post(size_t i, std::wstring message)
+{
+	std::lock_guard lock(mutex_);
+
+	// More messages than announced, e.g. files added while processing
+	if (i >= messages_.size())
+	{
+		messages_.resize(i + 1);
+		is_posted_.resize(i + 1, false);
+	}
+
+	messages_[i] = std::move(message);
+	is_posted_[i] = true;
+
+	// Flushing everything that is now contiguous with what has been printed
+	for (; next_ < messages_.size() && is_posted_[next_]; ++next_)
+	{
+		os_ << messages_[next_];
+		std::wstring{}.swap(messages_[next_]);
+	}
+
+	os_.flush();
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of threads picking up tasks in the order of submission
+class WorkerPool
+{
+private:
+	std::vector<std::thread> threads_;
+	std::queue<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable task_ready_;
+	std::condition_variable all_done_;
+	size_t n_unfinished_ = 0;
+	bool is_stopping_ = false;
+
+	void Run();
+
+public:
+	WorkerPool() = delete;
+	explicit WorkerPool(size_t n_threads);
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool();
+
+	size_t Size() const { return threads_.size(); }
+
+	void Submit(std::function<void()> task);
+	void Wait();
+};
+
+// Collects messages posted out of order and prints them strictly by index
+class OrderedOutput
+{
+private:
+	std::wostream& os_;
+	std::vector<std::wstring> messages_;
+	std::vector<bool> is_posted_;
+	size_t next_ = 0;
+	std::mutex mutex_;
+
+public:
+	OrderedOutput() = delete;
+	OrderedOutput(std::wostream& os, size_t n_messages);
+
+	void Post(size_t i, std::wstring message);
+};
\ No newline at end of file